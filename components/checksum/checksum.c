@@ -0,0 +1,167 @@
+#include "checksum.h"
+#include <inttypes.h>
+#include <string.h>
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define CRC32_POLY 0xEDB88320
+#define CRC8_POLY  0x07
+
+#define CRC32_SELECT_SIZE 4096 // Bytes each CRC-32 backend is timed on, one background row
+
+static const char *TAG = "Checksum";
+
+// Written once by checksum_init() before any task uses them, read-only after
+static uint32_t crc32_table[8][256];
+static uint8_t crc8_table[256];
+
+typedef uint32_t (*crc32_backend_t)(uint32_t crc, const uint8_t *buf, size_t len);
+static crc32_backend_t crc32_backend = crc32_update_slice8; // Chosen by crc32_select_backend()
+
+/* Build the eight slicing tables, table[0] is the classic byte table */
+static void crc32_init_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++) {
+            c = (c & 1) ? (CRC32_POLY ^ (c >> 1)) : (c >> 1);
+        }
+        crc32_table[0][i] = c;
+    }
+
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = crc32_table[t - 1][i];
+            crc32_table[t][i] = (prev >> 8) ^ crc32_table[0][prev & 0xFF];
+        }
+    }
+}
+
+static void crc8_init_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint8_t c = i;
+        for (int bit = 0; bit < 8; bit++) {
+            c = (c & 0x80) ? ((c << 1) ^ CRC8_POLY) : (c << 1);
+        }
+        crc8_table[i] = c;
+    }
+}
+
+uint32_t crc32_update_rom(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    return esp_rom_crc32_le(crc, buf, len);
+}
+
+/**
+ * @brief CRC-32 processing eight bytes per step with the slicing-by-8 tables.
+ *
+ * @param crc   Previous result, CHECKSUM_CRC32_SEED to start a new chain.
+ * @param buf   Data.
+ * @param len   Number of bytes in @p buf.
+ *
+ * @return Updated CRC.
+ */
+uint32_t crc32_update_slice8(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    crc ^= 0xFFFFFFFF;
+
+    // Byte at a time until aligned for the word loads
+    while (len && ((uintptr_t)buf & 3)) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *buf++) & 0xFF];
+        len--;
+    }
+
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, buf, 4);
+        memcpy(&hi, buf + 4, 4);
+        lo ^= crc;
+        crc = crc32_table[7][lo & 0xFF] ^
+              crc32_table[6][(lo >> 8) & 0xFF] ^
+              crc32_table[5][(lo >> 16) & 0xFF] ^
+              crc32_table[4][lo >> 24] ^
+              crc32_table[3][hi & 0xFF] ^
+              crc32_table[2][(hi >> 8) & 0xFF] ^
+              crc32_table[1][(hi >> 16) & 0xFF] ^
+              crc32_table[0][hi >> 24];
+        buf += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *buf++) & 0xFF];
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+/*
+ * Time both CRC-32 backends and keep the faster one. Which wins depends on
+ * the cache and on where the data and the slicing tables live, so it is
+ * measured on the chip rather than guessed. The slicing tables themselves
+ * are the sample, they are as large as one background row.
+ */
+static void crc32_select_backend(void)
+{
+    _Static_assert(sizeof(crc32_table) >= CRC32_SELECT_SIZE, "CRC32 sample too small");
+    const uint8_t *sample = (const uint8_t *)crc32_table;
+
+    // Warm the cache so neither run pays for it
+    crc32_update_slice8(CHECKSUM_CRC32_SEED, sample, CRC32_SELECT_SIZE);
+
+    int64_t start = esp_timer_get_time();
+    uint32_t crc_rom = crc32_update_rom(CHECKSUM_CRC32_SEED, sample, CRC32_SELECT_SIZE);
+    int64_t rom_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    uint32_t crc_slice8 = crc32_update_slice8(CHECKSUM_CRC32_SEED, sample, CRC32_SELECT_SIZE);
+    int64_t slice8_us = esp_timer_get_time() - start;
+
+    if (crc_rom != crc_slice8) {
+        ESP_LOGE(TAG, "CRC32 backends disagree, using slice-8");
+        crc32_backend = crc32_update_slice8;
+    } else {
+        crc32_backend = (rom_us < slice8_us) ? crc32_update_rom : crc32_update_slice8;
+    }
+    ESP_LOGI(TAG, "CRC32 over %d bytes: ROM %" PRId64 " us, slice-8 %" PRId64 " us, using %s",
+             CRC32_SELECT_SIZE, rom_us, slice8_us, crc32_backend == crc32_update_rom ? "ROM" : "slice-8");
+}
+
+/**
+ * @brief Build the CRC tables and pick the CRC-32 backend.
+ *
+ * Call once at startup, before any task uses the checksum functions. The
+ * tables and the backend are only read after this, so the mirror task,
+ * the prepare worker and the httpd workers can share them without locking.
+ */
+void checksum_init(void)
+{
+    crc32_init_table();
+    crc8_init_table();
+    crc32_select_backend();
+}
+
+/**
+ * @brief CRC-32 with the backend checksum_init() found fastest on this chip.
+ *
+ * @param crc   Previous result, CHECKSUM_CRC32_SEED to start a new chain.
+ * @param buf   Data.
+ * @param len   Number of bytes in @p buf.
+ *
+ * @return Updated CRC.
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    return crc32_backend(crc, buf, len);
+}
+
+uint8_t crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0x00;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc8_table[crc ^ data[i]];
+    }
+    return crc;
+}
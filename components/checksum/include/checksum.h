@@ -0,0 +1,24 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CHECKSUM_CRC32_SEED 0xFFFFFFFF // Start value for a new crc32_update chain
+
+/* Build the tables and pick the CRC-32 backend, once at startup before any other call */
+void checksum_init(void);
+
+/*
+ * CRC-32 (IEEE 802.3, reflected poly 0xEDB88320) in zlib chaining form:
+ * pass the previous result back in to continue over several buffers.
+ * Every backend returns identical values.
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, size_t len);
+uint32_t crc32_update_rom(uint32_t crc, const uint8_t *buf, size_t len);
+uint32_t crc32_update_slice8(uint32_t crc, const uint8_t *buf, size_t len);
+
+/* CRC-8 (poly 0x07, initial 0x00) */
+uint8_t crc8(const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef ASYNC_HANDLER_H
+#define ASYNC_HANDLER_H
+
+#include "esp_http_server.h"
+#include "esp_err.h"
+
+esp_err_t async_handler_init(void);
+bool is_on_async_worker_thread(void);
+esp_err_t submit_async_req(httpd_req_t *req, httpd_handler_t handler);
+esp_err_t send_async_busy_response(httpd_req_t *req);
+
+#endif // ASYNC_HANDLER_H
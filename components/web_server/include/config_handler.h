@@ -9,6 +9,10 @@ void get_json_data_input_info(char **ptr, uint32_t *max_len);
 void get_json_data_output_info(char **ptr, uint32_t *max_len);
 void get_option_list_info(char **ptr, uint32_t *max_len);
 void get_pid_list_info(char **ptr, uint32_t *max_len);
+void set_json_data_input_len(uint32_t len);
+uint32_t get_json_data_output_len(void);
+void set_option_list_len(uint32_t len);
+void set_pid_list_len(uint32_t len);
 void Generate_TX_Message( PKE_PACKET_MANAGER dev, KE_CP_OP_CODES cmd, void *args );
 bool receive_config(const char *json_str);
 KE_PACKET_MANAGER *get_stm32_comm(void);
@@ -0,0 +1,143 @@
+// async_handler.c
+
+#include "async_handler.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "AsyncHandler";
+
+#define ASYNC_WORKER_TASK_COUNT      2
+#define ASYNC_WORKER_TASK_STACK_SIZE (6144)
+#define ASYNC_WORKER_TASK_PRIORITY   5
+
+typedef struct
+{
+    httpd_req_t *req;
+    httpd_handler_t handler;
+} httpd_async_req_t;
+
+static QueueHandle_t async_req_queue;
+static SemaphoreHandle_t worker_ready_count;
+static TaskHandle_t worker_handles[ASYNC_WORKER_TASK_COUNT];
+
+/* True when called from one of the async workers, false from the httpd task */
+bool is_on_async_worker_thread(void)
+{
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < ASYNC_WORKER_TASK_COUNT; i++)
+    {
+        if (worker_handles[i] == handle)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Hand a request over to an async worker and release the httpd task.
+ *
+ * The request is copied with httpd_req_async_handler_begin() so its socket
+ * stays open after the handler returns. The worker calls @p handler again,
+ * which sees is_on_async_worker_thread() and does the slow work itself.
+ *
+ * @param req       Request received on the httpd task.
+ * @param handler   Handler to run on the worker.
+ *
+ * @return ESP_OK if queued, ESP_FAIL if every worker is busy.
+ */
+esp_err_t submit_async_req(httpd_req_t *req, httpd_handler_t handler)
+{
+    // Refuse rather than block the httpd task when all workers are busy
+    if (xSemaphoreTake(worker_ready_count, 0) == pdFALSE)
+    {
+        ESP_LOGW(TAG, "No async workers available");
+        return ESP_FAIL;
+    }
+
+    httpd_req_t *copy = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &copy);
+    if (err != ESP_OK)
+    {
+        xSemaphoreGive(worker_ready_count);
+        return err;
+    }
+
+    httpd_async_req_t async_req = {
+        .req = copy,
+        .handler = handler,
+    };
+
+    if (xQueueSend(async_req_queue, &async_req, 0) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Async request queue full");
+        httpd_req_async_handler_complete(copy);
+        xSemaphoreGive(worker_ready_count);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/* All async workers are tied up with the STM32, ask the browser to retry */
+esp_err_t send_async_busy_response(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_send(req, "{\"error\": \"STM32 busy, try again\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+static void async_req_worker_task(void *p)
+{
+    ESP_LOGI(TAG, "Starting async request worker");
+
+    while (true)
+    {
+        httpd_async_req_t async_req;
+        if (xQueueReceive(async_req_queue, &async_req, portMAX_DELAY))
+        {
+            ESP_LOGD(TAG, "Invoking %s", async_req.req->uri);
+            async_req.handler(async_req.req);
+
+            if (httpd_req_async_handler_complete(async_req.req) != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Failed to complete async request");
+            }
+
+            xSemaphoreGive(worker_ready_count);
+        }
+    }
+}
+
+esp_err_t async_handler_init(void)
+{
+    if (async_req_queue)
+    {
+        return ESP_OK;
+    }
+
+    worker_ready_count = xSemaphoreCreateCounting(ASYNC_WORKER_TASK_COUNT, ASYNC_WORKER_TASK_COUNT);
+    async_req_queue = xQueueCreate(ASYNC_WORKER_TASK_COUNT, sizeof(httpd_async_req_t));
+    if (!worker_ready_count || !async_req_queue)
+    {
+        ESP_LOGE(TAG, "Failed to create async worker queue");
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < ASYNC_WORKER_TASK_COUNT; i++)
+    {
+        if (xTaskCreate(async_req_worker_task, "async_req_worker",
+                        ASYNC_WORKER_TASK_STACK_SIZE, NULL,
+                        ASYNC_WORKER_TASK_PRIORITY, &worker_handles[i]) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to start async request worker");
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
@@ -6,6 +6,10 @@
 #include <sys/param.h>
 #include "stm_flash.h"
 #include "stm_gpio.h"
+#include "async_handler.h"
+#include "ke_txn.h"
+#include "ke_sched.h"
+#include "stm32_link.h"
 
 static const char *TAG = "ConfigHandler";
 
@@ -17,6 +21,11 @@ static char *json_data_input;
 static char *json_data_output;
 static char *option_list;
 
+// Bytes of valid JSON in each buffer, saves scanning up to JSON_BUF_SIZE
+static uint32_t json_data_input_len;
+static uint32_t json_data_output_len;
+static uint32_t option_list_len;
+
 void get_json_data_input_info(char **ptr, uint32_t *max_len)
 {
     if (ptr)
@@ -41,6 +50,31 @@ void get_option_list_info(char **ptr, uint32_t *max_len)
         *max_len = OPTION_LIST_SIZE;
 }
 
+/* The STM32 is not answering, say so now instead of waiting out a request timeout */
+static esp_err_t send_link_down_response(httpd_req_t *req)
+{
+    ESP_LOGW(TAG, "STM32 link is down, %s refused", req->uri);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Retry-After", "5");
+    return httpd_resp_send(req, "{\"error\": \"STM32 not responding\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+void set_json_data_input_len(uint32_t len)
+{
+    json_data_input_len = len;
+}
+
+uint32_t get_json_data_output_len(void)
+{
+    return json_data_output_len;
+}
+
+void set_option_list_len(uint32_t len)
+{
+    option_list_len = len;
+}
+
 esp_err_t config_options_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "GET /api/options requested");
@@ -54,16 +88,26 @@ esp_err_t config_options_handler(httpd_req_t *req)
     
     ESP_LOGD(TAG, "Sending options data: %s", option_list);
     httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, option_list, HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send(req, option_list, option_list_len);
 }
 
 esp_err_t config_get_handler(httpd_req_t *req)
 {
     if(json_data_input[0] == '\0')
     {
-        memset(json_data_input, '\0', JSON_BUF_SIZE);
-        Generate_TX_Message(get_stm32_comm(), KE_CONFIG_REQUEST, 0);
-        KE_wait_for_response(get_stm32_comm(), 5000);
+        if (!stm32_link_available())
+            return send_link_down_response(req);
+
+        // Fetching from the STM32 can take seconds, keep the httpd task free meanwhile
+        if (!is_on_async_worker_thread())
+        {
+            if (submit_async_req(req, config_get_handler) == ESP_OK)
+                return ESP_OK;
+            return send_async_busy_response(req);
+        }
+
+        json_data_input_len = 0;
+        ke_txn_wait(ke_txn_begin(KE_TXN_CONFIG, 0), 5000, NULL);
     }
 
     ESP_LOGI(TAG, "GET /api/config requested");
@@ -74,16 +118,27 @@ esp_err_t config_get_handler(httpd_req_t *req)
     }
     ESP_LOGD(TAG, "Sending config data: %s", json_data_input);
     httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, json_data_input, HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send(req, json_data_input, json_data_input_len);
 }
 
 esp_err_t config_patch_handler(httpd_req_t *req)
 {
+    // Saving and resetting the STM32 takes seconds, run it on an async worker
+    if (!is_on_async_worker_thread())
+    {
+        if (submit_async_req(req, config_patch_handler) == ESP_OK)
+            return ESP_OK;
+        return send_async_busy_response(req);
+    }
+
     ESP_LOGI(TAG, "PATCH /api/config requested");
 
+    if (!stm32_link_available())
+        return send_link_down_response(req);
+
     int total_len = req->content_len;
 
-    int received = httpd_req_recv(req, json_data_output, MIN(total_len, JSON_BUF_SIZE));
+    int received = httpd_req_recv(req, json_data_output, MIN(total_len, JSON_BUF_SIZE - 1));
     if (received <= 0)
     {
         ESP_LOGE(TAG, "Failed to receive config PATCH payload");
@@ -91,19 +146,21 @@ esp_err_t config_patch_handler(httpd_req_t *req)
     }
 
     json_data_output[received] = '\0';
+    json_data_output_len = received;
     ESP_LOGD(TAG, "Received config update: %s", json_data_output);
 
     // Now save to STM
-    Generate_TX_Message(get_stm32_comm(), KE_CONFIG_SEND, 0);
-    KE_wait_for_response(get_stm32_comm(), 2500);
+    ke_sched_request(get_stm32_comm(), KE_SCHED_CONFIG, KE_CONFIG_SEND, 0, 2500);
 
     // The config has been changed, invalidate cached json input data
-    memset(json_data_input, '\0', JSON_BUF_SIZE);
+    json_data_input[0] = '\0';
+    json_data_input_len = 0;
 
     // Brute force hot-reload. This can be done better
     vTaskDelay(pdMS_TO_TICKS(250));
     stm_gpio_splash_disable(true);
     stm32_reset();
+    stm32_link_expect_reset();
 
     // Send HTTP response - always return success since we got this far
     httpd_resp_set_type(req, "application/json");
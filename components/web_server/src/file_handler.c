@@ -26,6 +26,8 @@
  */
 
 #include "file_handler.h"
+#include "bg_manifest.h"
+#include "bg_ingest.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
@@ -258,6 +260,11 @@ esp_err_t file_handler_delete(const char *filepath)
     if (unlink(filepath) == 0)
     {
         ESP_LOGI(TAG, "File deleted successfully: %s", filepath);
+        if (CHECK_FILE_EXTENSION(filepath, ".png"))
+        {
+            bg_manifest_remove(filepath);
+            bg_ingest_remove(filepath);
+        }
         return ESP_OK;
     }
     else
@@ -547,6 +554,12 @@ static esp_err_t spiffs_upload_handler(httpd_req_t *req)
 
     ESP_LOGI(TAG, "File uploaded successfully: %s (%d bytes)", filepath, total_received);
 
+    if (CHECK_FILE_EXTENSION(filepath, ".png"))
+    {
+        bg_ingest_remove(filepath);
+        bg_manifest_update(filepath);
+    }
+
     // Respond
     httpd_resp_set_type(req, "application/json");
     char response[256];
@@ -27,6 +27,8 @@
 
 #include "images_handler.h"
 #include "file_handler.h"
+#include "bg_manifest.h"
+#include "bg_ingest.h"
 #include "esp_err.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
@@ -52,7 +54,7 @@ static const char *TAG = "ImagesHandler";
 #define HTTPD_413_PAYLOAD_TOO_LARGE 413
 #endif
 
-extern void mirror_spiffs(void);
+extern bool mirror_spiffs_request(void);
 
 static void url_decode(char *dest, const char *src, size_t dest_size)
 {
@@ -263,6 +265,12 @@ esp_err_t image_upload_handler(httpd_req_t *req)
         return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create file");
     }
 
+    // Backgrounds are decoded while they stream in, so a sync never has to decode the PNG again
+    bg_ingest_t *ingest = NULL;
+    if (strcmp(extension, ".png") == 0) {
+        ingest = bg_ingest_begin(filepath);
+    }
+
     // ---- Receive and write file data ----
     int remaining = req->content_len;
     char buf[4096];
@@ -279,11 +287,13 @@ esp_err_t image_upload_handler(httpd_req_t *req)
             }
             ESP_LOGE(TAG, "Socket error: %d", received);
             file_handler_close(file);
+            bg_ingest_abort(ingest);
             file_handler_delete(filepath);
             return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "File upload failed");
         } else if (received == 0) {
             ESP_LOGE(TAG, "Connection closed before file fully received");
             file_handler_close(file);
+            bg_ingest_abort(ingest);
             file_handler_delete(filepath);
             return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Upload incomplete");
         }
@@ -292,10 +302,21 @@ esp_err_t image_upload_handler(httpd_req_t *req)
         if (written != received) {
             ESP_LOGE(TAG, "File write error (%d vs %d)", written, received);
             file_handler_close(file);
+            bg_ingest_abort(ingest);
             file_handler_delete(filepath);
             return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "File write failed");
         }
 
+        esp_err_t ingest_err = ingest ? bg_ingest_feed(ingest, (const uint8_t *)buf, received) : ESP_OK;
+        if (ingest_err != ESP_OK) {
+            file_handler_close(file);
+            bg_ingest_abort(ingest);
+            file_handler_delete(filepath);
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                       ingest_err == ESP_ERR_INVALID_SIZE ? "Background must be 1024x200"
+                                                                          : "Invalid PNG");
+        }
+
         remaining -= received;
         total_received += received;
     }
@@ -304,6 +325,14 @@ esp_err_t image_upload_handler(httpd_req_t *req)
 
     ESP_LOGI(TAG, "File uploaded successfully: %s (%d bytes)", filepath, total_received);
 
+    if (ingest && bg_ingest_finish(ingest) != ESP_OK) {
+        file_handler_delete(filepath);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid PNG");
+    } else if (!ingest && strcmp(extension, ".png") == 0) {
+        // No memory to ingest, decode once now so the next sync can compare CRCs
+        bg_manifest_update(filepath);
+    }
+
     // ---- Send success response ----
     httpd_resp_set_type(req, "application/json");
     char response[256];
@@ -385,8 +414,11 @@ esp_err_t mirror_spiffs_post_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Mirror request received");
 
-    mirror_spiffs();
+    // The sync runs on the mirror task, the reply does not wait for it
+    if (!mirror_spiffs_request())
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Mirror not available");
 
+    httpd_resp_set_status(req, "202 Accepted");
     httpd_resp_set_type(req, "application/json");
     return httpd_resp_sendstr(req, "{\"message\":\"Mirror started\"}");
 }
@@ -5,6 +5,8 @@
 #include "esp_ota_ops.h"
 #include "esp_http_server.h"
 #include "stm32_uart.h"
+#include "ke_sched.h"
+#include "stm32_link.h"
 #include "ota_handler.h"
 #include "stm_flash.h"
 
@@ -86,6 +88,7 @@ esp_err_t web_update_post_handler(httpd_req_t *req)
 }
 
 #define BINARY_CHUNK_SIZE 32768
+#define BINARY_CHUNK_ATTEMPTS 3 // Sends per chunk on NACK, a timed out chunk is never resent
 static uint8_t *binary_chunk = NULL;
 static size_t current_chunk_len = 0;
 static size_t current_offset = 0;
@@ -192,10 +195,12 @@ void flash_stm32_firmware_task(void *pvParameter)
 
     current_offset = 0;
 
+    // The bootloader does not answer heartbeats
+    stm32_link_set_heartbeat(false);
+
     // Enter bootloader mode
     update_stm_flash_progress(0, "Entering bootloader mode");
-    Generate_TX_Message(get_stm32_comm(), KE_ENTER_BOOTLOADER, NULL);
-    KE_wait_for_response(get_stm32_comm(), 5000);
+    ke_sched_request(get_stm32_comm(), KE_SCHED_CONTROL, KE_ENTER_BOOTLOADER, NULL, 5000);
 
     while ((read_len = fread(binary_chunk, 1, BINARY_CHUNK_SIZE, file)) > 0)
     {
@@ -207,12 +212,13 @@ void flash_stm32_firmware_task(void *pvParameter)
         int percentage = (int)((current_offset * 100) / total_size);
         update_stm_flash_progress(percentage, "Flashing firmware");
 
-        // Send chunk (KE lib will internally call get_binary_chunk_data)
-        Generate_TX_Message(get_stm32_comm(), KE_BINARY_SEND_CHUNK, &current_offset);
-
-        // Wait for ACK from STM32
-        if (KE_wait_for_response(get_stm32_comm(), 20000) != KE_ACK)
+        // Send chunk and wait for ACK (KE lib will internally call get_binary_chunk_data)
+        // The link is released between chunks so other traffic is not starved
+        // A NACK resends this chunk only, a timeout fails the flash since the chunk may already be programmed
+        if (ke_sched_request_retry(get_stm32_comm(), KE_SCHED_BULK, KE_BINARY_SEND_CHUNK, &current_offset,
+                                   20000, BINARY_CHUNK_ATTEMPTS) != KE_ACK)
         {
+            ESP_LOGE(TAG, "Chunk at offset %d failed after %d attempts", current_offset, BINARY_CHUNK_ATTEMPTS);
             success = false;
             break;
         }
@@ -227,6 +233,7 @@ void flash_stm32_firmware_task(void *pvParameter)
         ESP_LOGI(TAG, "STM32 firmware flashed successfully (%lu bytes)", (unsigned long)current_offset);
         update_stm_flash_progress(100, "Resetting STM32");
         stm32_reset();
+        stm32_link_expect_reset();
         ESP_LOGI(TAG, "STM32 reset to run new firmware");
         set_stm_flash_complete();
     }
@@ -236,6 +243,7 @@ void flash_stm32_firmware_task(void *pvParameter)
         set_stm_flash_error("Flash operation failed");
     }
 
+    stm32_link_set_heartbeat(true);
     vTaskDelete(NULL);
 }
 
@@ -248,7 +256,8 @@ void flash_stm32_bootloader(const char *firmware_path)
     reset_stm_flash_progress();
     update_stm_flash_progress(0, "Initializing bootloader mode");
 
-    // Switch UART to bootloader mode
+    // Switch UART to bootloader mode, the heartbeat stays off until the KE UART is back
+    stm32_link_set_heartbeat(false);
     uart_init_for_stm32_bootloader();
     ESP_LOGI(TAG, "UART initialized for STM32 bootloader");
 
@@ -275,6 +284,7 @@ void flash_stm32_bootloader(const char *firmware_path)
     // Reset STM32 to run new bootloader
     update_stm_flash_progress(100, "Resetting STM32");
     stm32_reset();
+    stm32_link_expect_reset();
     ESP_LOGI(TAG, "STM32 reset to run new bootloader");
     set_stm_flash_complete();
 }
@@ -319,6 +329,7 @@ esp_err_t bootloader_update_post_handler(httpd_req_t *req)
     flash_stm32_bootloader("STM32U5G9ZJTXQ_OSPI_Bootloader.bin");
     vTaskDelay(pdMS_TO_TICKS(1000));
     uart_init(get_stm32_comm());
+    stm32_link_set_heartbeat(true);
     httpd_resp_set_type(req, "application/json");
     httpd_resp_sendstr(req, "{\"message\": \"STM32 bootloader update started\"}");
     return ESP_OK;
@@ -10,6 +10,7 @@ static const char *TAG = "PIDsHandler";
 #define PID_LIST_SIZE 10000
 
 static char *pid_list;
+static uint32_t pid_list_len;
 
 void get_pid_list_info(char **ptr, uint32_t *max_len)
 {
@@ -19,18 +20,28 @@ void get_pid_list_info(char **ptr, uint32_t *max_len)
         *max_len = PID_LIST_SIZE;
 }
 
+void set_pid_list_len(uint32_t len)
+{
+    pid_list_len = len;
+}
+
 esp_err_t get_pids_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "GET /api/pids requested");
     ESP_LOGD(TAG, "Sending PID list: %s", pid_list);
 
     httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, pid_list, HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send(req, pid_list, pid_list_len);
 }
 
 esp_err_t pids_handler_init_buffer(void)
 {
     pid_list = heap_caps_malloc(PID_LIST_SIZE, MALLOC_CAP_SPIRAM);
+    if (!pid_list)
+        return ESP_FAIL;
+
+    pid_list[0] = '\0';
+    pid_list_len = 0;
     return ESP_OK;
 }
 
@@ -3,8 +3,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "config_handler.h"
+#include "async_handler.h"
+#include "ke_sched.h"
+#include "stm32_link.h"
 #include "esp_vfs.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_http_server.h"
 #include "esp_err.h"
 #include "images_handler.h"
@@ -18,7 +22,8 @@
 #include <lwip/sockets.h>
 
 // External function declaration
-extern void mirror_spiffs(void);
+extern bool mirror_spiffs_request(void);
+extern bool mirror_sync_status(int *views, int *pending);
 
 static const char *TAG = "WebServer";
 
@@ -292,6 +297,7 @@ esp_err_t stm32_reset_handler(httpd_req_t *req)
 
     // Reset the STM32
     stm32_reset();
+    stm32_link_expect_reset();
 
     return ret;
 }
@@ -303,13 +309,70 @@ esp_err_t sync_handler(httpd_req_t *req)
     httpd_resp_set_type(req, "application/json");
     httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
 
-    // Call the mirror_spiffs function first
-    mirror_spiffs();
+    // The sync runs on the mirror task, poll /api/sync/status for its progress
+    if (!mirror_spiffs_request())
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Background sync not available");
 
-    const char* success_response = "{\"success\":true,\"message\":\"Backgrounds synced successfully\"}";
-    esp_err_t ret = httpd_resp_send(req, success_response, strlen(success_response));
+    httpd_resp_set_status(req, "202 Accepted");
+    const char* success_response = "{\"success\":true,\"message\":\"Background sync started\"}";
+    return httpd_resp_send(req, success_response, HTTPD_RESP_USE_STRLEN);
+}
 
-    return ret;
+esp_err_t sync_status_handler(httpd_req_t *req)
+{
+    // The status runs the CRC batch over the link, keep the httpd task free meanwhile
+    if (!is_on_async_worker_thread())
+    {
+        if (submit_async_req(req, sync_status_handler) == ESP_OK)
+            return ESP_OK;
+        return send_async_busy_response(req);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    int views = 0, pending = 0;
+    if (!mirror_sync_status(&views, &pending))
+    {
+        const char *busy_response = "{\"syncing\":true}";
+        return httpd_resp_send(req, busy_response, HTTPD_RESP_USE_STRLEN);
+    }
+
+    char response[64];
+    snprintf(response, sizeof(response), "{\"syncing\":false,\"views\":%d,\"pending\":%d}", views, pending);
+    return httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t link_stats_handler(httpd_req_t *req)
+{
+    static const char *class_names[KE_SCHED_CLASS_COUNT] = {"control", "config", "bulk"};
+    ke_sched_class_stats_t stats[KE_SCHED_CLASS_COUNT];
+    ke_sched_get_stats(stats);
+
+    static const char *state_names[] = {"unknown", "up", "down"};
+    int64_t last_rx_us = stm32_link_last_rx_us();
+    uint32_t quiet_ms = last_rx_us ? (uint32_t)((esp_timer_get_time() - last_rx_us) / 1000) : 0;
+
+    char response[640];
+    int len = snprintf(response, sizeof(response), "{\"link\":{\"state\":\"%s\",\"quiet_ms\":%lu},",
+                       state_names[stm32_link_get_state()], (unsigned long)quiet_ms);
+    for (int i = 0; i < KE_SCHED_CLASS_COUNT; i++)
+    {
+        uint32_t avg_wait_us = stats[i].requests ? (uint32_t)(stats[i].total_wait_us / stats[i].requests) : 0;
+        len += snprintf(response + len, sizeof(response) - len,
+                        "%s\"%s\":{\"requests\":%lu,\"depth\":%lu,\"max_depth\":%lu,"
+                        "\"avg_wait_us\":%lu,\"max_wait_us\":%lu,\"retries\":%lu,\"preempts\":%lu}",
+                        i ? "," : "", class_names[i],
+                        (unsigned long)stats[i].requests, (unsigned long)stats[i].depth,
+                        (unsigned long)stats[i].max_depth, (unsigned long)avg_wait_us,
+                        (unsigned long)stats[i].max_wait_us, (unsigned long)stats[i].retries,
+                        (unsigned long)stats[i].preempts);
+    }
+    snprintf(response + len, sizeof(response) - len, "}");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
 }
 
 esp_err_t start_webserver()
@@ -325,7 +388,7 @@ esp_err_t start_webserver()
     config.recv_wait_timeout = 60;  // seconds
     config.send_wait_timeout = 60;  // seconds
     config.stack_size = HTTPD_TASK_STACK_SIZE;
-    config.max_uri_handlers = 24; // Increased to accommodate all routes
+    config.max_uri_handlers = 26; // Increased to accommodate all routes
     config.uri_match_fn = httpd_uri_match_wildcard;
 
     config.backlog_conn = 8;         // allow short connection bursts
@@ -362,6 +425,13 @@ esp_err_t start_webserver()
         return ESP_FAIL;
     }
 
+    if (async_handler_init() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start async request workers");
+        httpd_stop(server);
+        return ESP_FAIL;
+    }
+
     if (register_config_routes(server) != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to register config endpoints");
@@ -422,6 +492,20 @@ esp_err_t start_webserver()
                                            .handler = sync_handler,
                                            .user_ctx = NULL});
 
+    // Register background sync estimate, how many views a sync would send
+    httpd_register_uri_handler(server, &(httpd_uri_t){
+                                           .uri = "/api/sync/status",
+                                           .method = HTTP_GET,
+                                           .handler = sync_status_handler,
+                                           .user_ctx = NULL});
+
+    // Register STM32 link scheduler statistics
+    httpd_register_uri_handler(server, &(httpd_uri_t){
+                                           .uri = "/api/link/stats",
+                                           .method = HTTP_GET,
+                                           .handler = link_stats_handler,
+                                           .user_ctx = NULL});
+
     if (register_spiffs(server) != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to register SPIFFS endpoints");
@@ -8,7 +8,7 @@ export async function POST() {
 		if (!success) {
 			return json({ error: 'Failed to sync backgrounds' }, { status: 500 });
 		}
-		return json({ message: 'Backgrounds synced successfully' });
+		return json({ message: 'Background sync started' });
 	} catch (err) {
 		console.error('Sync API error:', err);
 		return json({ error: 'Sync request failed' }, { status: 500 });
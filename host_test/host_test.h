@@ -0,0 +1,61 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+/*
+ * Helpers shared by the host tests. Each test binary checks its module and
+ * exits non-zero on the first failure; run with --bench it also prints
+ * timings. Host timings only compare backends against each other, they are
+ * not target numbers.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+
+#define HOST_TEST_BENCH_RUNS 8
+
+#define CHECK(cond) do {                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+static inline bool host_test_bench_mode(int argc, char **argv)
+{
+    return argc > 1 && strcmp(argv[1], "--bench") == 0;
+}
+
+/* Path of a file in the repository, e.g. "spiffs/User1.png" */
+static inline const char *host_test_path(const char *rel)
+{
+    static char path[512];
+    snprintf(path, sizeof(path), "%s/%s", HOST_TEST_REPO_DIR, rel);
+    return path;
+}
+
+/* Read a whole repository file, caller frees */
+static inline uint8_t *host_test_read_file(const char *rel, size_t *len)
+{
+    FILE *fp = fopen(host_test_path(rel), "rb");
+    if (!fp) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (data && fread(data, 1, size, fp) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    *len = data ? (size_t)size : 0;
+    return data;
+}
+
+#endif
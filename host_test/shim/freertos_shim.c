@@ -0,0 +1,391 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "host_sim.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify;
+    bool notify_pending;        // Set by any notification, cleared by the wait that takes it
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;      // 0 for semaphores, only the count matters
+    UBaseType_t count;
+    UBaseType_t head;
+    int64_t sim_us;             // Latest simulated time anything was put in
+};
+
+struct host_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+static __thread struct host_task *host_current_task;
+static __thread int64_t host_sim_now_us;
+
+int64_t host_sim_time_us(void)
+{
+    return host_sim_now_us;
+}
+
+void host_sim_advance(int64_t us)
+{
+    host_sim_now_us += us;
+}
+
+void host_sim_advance_to(int64_t us)
+{
+    if (us > host_sim_now_us) {
+        host_sim_now_us = us;
+    }
+}
+
+/* Absolute real time deadline for a wait of @p ticks */
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ) + ts.tv_nsec;
+    ts.tv_sec += ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    return ts;
+}
+
+/* One wait on @p cond, returns false once @p ticks have run out */
+static bool host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static void host_unlock(void *lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+static void *host_task_entry(void *arg)
+{
+    struct host_task *task = arg;
+    host_current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+static struct host_task *host_task_alloc(void)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task) {
+        pthread_mutex_init(&task->lock, NULL);
+        pthread_cond_init(&task->notified, NULL);
+    }
+    return task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+
+    struct host_task *task = host_task_alloc();
+    if (!task) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    if (created) {
+        *created = task;
+    }
+    if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0) {
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (!task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_sim_advance((int64_t)ticks * (1000000 / configTICK_RATE_HZ));
+    sched_yield();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    task->notify_pending = true;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    // Threads that are not tasks get a notification slot on first use
+    if (!host_current_task) {
+        host_current_task = host_task_alloc();
+        host_current_task->thread = pthread_self();
+    }
+    struct host_task *task = host_current_task;
+    struct timespec deadline = host_deadline(ticks);
+
+    pthread_mutex_lock(&task->lock);
+    pthread_cleanup_push(host_unlock, &task->lock);
+    while (task->notify == 0 && host_wait(&task->notified, &task->lock, ticks, &deadline)) {}
+    pthread_cleanup_pop(0);
+
+    uint32_t value = task->notify;
+    if (value > 0) {
+        task->notify = clear_on_exit ? 0 : value - 1;
+    }
+    task->notify_pending = false;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    pthread_mutex_lock(&task->lock);
+    switch (action) {
+    case eSetBits:
+        task->notify |= value;
+        break;
+    case eIncrement:
+        task->notify++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify = value;
+        break;
+    case eNoAction:
+        break;
+    }
+    task->notify_pending = true;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    if (!host_current_task) {
+        host_current_task = host_task_alloc();
+        host_current_task->thread = pthread_self();
+    }
+    struct host_task *task = host_current_task;
+    struct timespec deadline = host_deadline(ticks);
+
+    pthread_mutex_lock(&task->lock);
+    if (!task->notify_pending) {
+        task->notify &= ~clear_on_entry;
+    }
+    pthread_cleanup_push(host_unlock, &task->lock);
+    while (!task->notify_pending && host_wait(&task->notified, &task->lock, ticks, &deadline)) {}
+    pthread_cleanup_pop(0);
+
+    BaseType_t received = task->notify_pending ? pdTRUE : pdFALSE;
+    if (value) {
+        *value = task->notify;
+    }
+    if (received) {
+        task->notify &= ~clear_on_exit;
+        task->notify_pending = false;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return received;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+    if (!queue) {
+        return NULL;
+    }
+    queue->items = calloc(length, item_size ? item_size : 1);
+    if (!queue->items) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t sent = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    pthread_cleanup_push(host_unlock, &queue->lock);
+    while (queue->count == queue->length && host_wait(&queue->changed, &queue->lock, ticks, &deadline)) {}
+    pthread_cleanup_pop(0);
+
+    if (queue->count < queue->length) {
+        UBaseType_t slot = (queue->head + queue->count) % queue->length;
+        if (queue->item_size) {
+            memcpy(queue->items + slot * queue->item_size, item, queue->item_size);
+        }
+        queue->count++;
+        if (host_sim_now_us > queue->sim_us) {
+            queue->sim_us = host_sim_now_us;
+        }
+        pthread_cond_broadcast(&queue->changed);
+        sent = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t received = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    pthread_cleanup_push(host_unlock, &queue->lock);
+    while (queue->count == 0 && host_wait(&queue->changed, &queue->lock, ticks, &deadline)) {}
+    pthread_cleanup_pop(0);
+
+    if (queue->count > 0) {
+        if (queue->item_size) {
+            memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        }
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        // Whatever was taken cannot be used before it was put in
+        host_sim_advance_to(queue->sim_us);
+        pthread_cond_broadcast(&queue->changed);
+        received = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return received;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->count = 0;
+    queue->head = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max_count, 0);
+    if (sem) {
+        sem->count = initial_count;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(sem, NULL, 0);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct host_event_group *group = calloc(1, sizeof(*group));
+    if (group) {
+        pthread_mutex_init(&group->lock, NULL);
+        pthread_cond_init(&group->changed, NULL);
+    }
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t value = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+
+    pthread_mutex_lock(&group->lock);
+    pthread_cleanup_push(host_unlock, &group->lock);
+    for (;;) {
+        bool met = wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+        if (met || !host_wait(&group->changed, &group->lock, ticks, &deadline)) {
+            break;
+        }
+    }
+    pthread_cleanup_pop(0);
+
+    EventBits_t value = group->bits;
+    bool met = wait_for_all ? (value & bits) == bits : (value & bits) != 0;
+    if (met && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
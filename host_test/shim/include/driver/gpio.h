@@ -0,0 +1,6 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+/* Nothing from the GPIO driver is used while CONFIG_STM32_READY_PIN is -1 */
+
+#endif
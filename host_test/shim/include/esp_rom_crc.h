@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_ROM_CRC_H
+#define HOST_ESP_ROM_CRC_H
+
+/*
+ * Host stand-in for the ESP32-S3 ROM CRC routines. The ROM cannot run here,
+ * a plain bitwise loop gives the same values so host timings of the ROM
+ * backend say nothing about the target.
+ */
+
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+uint8_t esp_rom_crc8_le(uint8_t crc, const uint8_t *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+/*
+ * Simulated time for the host build. Every thread has its own clock in
+ * microseconds, moved on by vTaskDelay() and by the fake UART while the
+ * thread waits for the wire. Taking from a queue or semaphore moves the
+ * taker's clock up to the latest time anything was given to it, so a task
+ * handed the link by another starts where that one left off. Real time is
+ * not involved, so link timings come out the same on any PC.
+ */
+
+#include <stdint.h>
+
+int64_t host_sim_time_us(void);
+void host_sim_advance(int64_t us);
+void host_sim_advance_to(int64_t us);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HOST_LIB_KE_PROTOCOL_H
+#define HOST_LIB_KE_PROTOCOL_H
+
+/* The part of the KE library stm32_uart.c and ke_sched.c use, tests provide the functions */
+
+#include <stdint.h>
+
+typedef struct ke_packet_manager *PKE_PACKET_MANAGER;
+
+typedef enum {
+    KE_ACK,
+    KE_NACK,
+    KE_TIMEOUT,
+} KE_STATUS;
+
+typedef enum {
+    KE_CONFIG_REQUEST,
+    KE_CONFIG_SEND,
+    KE_OPTION_LIST_REQUEST,
+    KE_PID_LIST_REQUEST,
+    KE_BACKGROUND_CRC_REQUEST,
+    KE_BACKGROUND_SEND,
+    KE_ENTER_BOOTLOADER,
+    KE_BINARY_SEND_CHUNK,
+} KE_CP_OP_CODES;
+
+void KE_Add_UART_Byte(PKE_PACKET_MANAGER dev, uint8_t byte);
+void Generate_TX_Message(PKE_PACKET_MANAGER dev, KE_CP_OP_CODES cmd, void *args);
+KE_STATUS KE_wait_for_response(PKE_PACKET_MANAGER dev, uint32_t timeout_ms);
+
+#endif
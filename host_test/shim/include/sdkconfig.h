@@ -0,0 +1,21 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+/* The options the host built sources read, at the defaults of the project sdkconfig */
+
+#define CONFIG_FREERTOS_HZ 100
+
+#define CONFIG_ESP32_STM32_UART_CONTROLLER      1
+#define CONFIG_ESP32_STM32_UART_BUFFER_SIZE     1024
+#define CONFIG_ESP32_STM32_UART_RX_RING_SIZE    8192
+#define CONFIG_STM32_RX_ESP32_TX                11
+#define CONFIG_STM32_TX_ESP32_RX                10
+#define CONFIG_STM32_READY_PIN                  -1
+
+// Set by the build for the RTS/CTS variant of a test
+#ifdef CONFIG_ESP32_STM32_UART_HW_FLOWCTRL
+#define CONFIG_STM32_RTS_ESP32_CTS              12
+#define CONFIG_STM32_CTS_ESP32_RTS              13
+#endif
+
+#endif
@@ -0,0 +1,211 @@
+#include "driver/uart.h"
+#include "host_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * One UART with TX wired to RX. Written bytes are timed on a simulated wire
+ * and land in the RX buffer straight away, posting a UART_DATA event per
+ * RX full threshold like the real driver. When the RX buffer is full the
+ * writer waits for the reader instead of dropping bytes, so the far end
+ * never slows the wire down: RTS/CTS stalls are not modelled.
+ */
+
+#define HOST_UART_RX_EVENT_SIZE 120 // Driver default RX full threshold
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t drained;
+    uint8_t *rx;
+    size_t rx_size;
+    size_t rx_head;
+    size_t rx_count;
+    QueueHandle_t events;
+    uint32_t baud;
+    uint32_t frame_bits;        // Start, data, parity and stop bits per byte
+    int64_t wire_free_us;       // Simulated time the last written byte leaves the TX pin
+    host_uart_stats_t stats;
+} host_uart = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+    .baud = 115200,
+    .frame_bits = 10,
+};
+
+/* Simulated time for @p bytes to cross the wire */
+static int64_t host_uart_wire_us(size_t bytes)
+{
+    return (int64_t)bytes * host_uart.frame_bits * 1000000 / host_uart.baud;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *queue, int intr_alloc_flags)
+{
+    (void)port;
+    (void)tx_buffer_size;
+    (void)intr_alloc_flags;
+
+    pthread_mutex_lock(&host_uart.lock);
+    free(host_uart.rx);
+    host_uart.rx = malloc(rx_buffer_size);
+    host_uart.rx_size = rx_buffer_size;
+    host_uart.rx_head = 0;
+    host_uart.rx_count = 0;
+    host_uart.events = queue ? xQueueCreate(queue_size, sizeof(uart_event_t)) : NULL;
+    host_uart.wire_free_us = 0;
+    memset(&host_uart.stats, 0, sizeof(host_uart.stats));
+    pthread_mutex_unlock(&host_uart.lock);
+
+    if (queue) {
+        *queue = host_uart.events;
+    }
+    return host_uart.rx ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+    (void)port;
+    pthread_mutex_lock(&host_uart.lock);
+    free(host_uart.rx);
+    host_uart.rx = NULL;
+    host_uart.rx_count = 0;
+    host_uart.events = NULL;
+    pthread_mutex_unlock(&host_uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    (void)port;
+    pthread_mutex_lock(&host_uart.lock);
+    host_uart.baud = config->baud_rate;
+    host_uart.frame_bits = 1 + (5 + config->data_bits) +
+                           (config->parity != UART_PARITY_DISABLE ? 1 : 0) +
+                           (config->stop_bits == UART_STOP_BITS_1 ? 1 : 2);
+    pthread_mutex_unlock(&host_uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    (void)port;
+    (void)tx;
+    (void)rx;
+    (void)rts;
+    (void)cts;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud)
+{
+    (void)port;
+    pthread_mutex_lock(&host_uart.lock);
+    host_uart.baud = baud;
+    pthread_mutex_unlock(&host_uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    (void)port;
+    pthread_mutex_lock(&host_uart.lock);
+    host_uart.rx_count = 0;
+    pthread_cond_broadcast(&host_uart.drained);
+    pthread_mutex_unlock(&host_uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    (void)port;
+    pthread_mutex_lock(&host_uart.lock);
+    *size = host_uart.rx_count;
+    pthread_mutex_unlock(&host_uart.lock);
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+    (void)port;
+    (void)ticks;
+
+    pthread_mutex_lock(&host_uart.lock);
+    size_t len = length < host_uart.rx_count ? length : host_uart.rx_count;
+    for (size_t i = 0; i < len; i++) {
+        ((uint8_t *)buf)[i] = host_uart.rx[host_uart.rx_head];
+        host_uart.rx_head = (host_uart.rx_head + 1) % host_uart.rx_size;
+    }
+    host_uart.rx_count -= len;
+    pthread_cond_broadcast(&host_uart.drained);
+    pthread_mutex_unlock(&host_uart.lock);
+    return (int)len;
+}
+
+/**
+ * @brief Put @p size bytes on the wire and loop them back into RX.
+ *
+ * With no TX ring the real call returns once the last bytes are in the
+ * hardware FIFO, so the caller's clock moves to one FIFO short of the end
+ * of the frame on the wire.
+ */
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    const uint8_t *data = src;
+
+    pthread_mutex_lock(&host_uart.lock);
+    int64_t start = host_sim_time_us() > host_uart.wire_free_us ? host_sim_time_us() : host_uart.wire_free_us;
+    host_uart.wire_free_us = start + host_uart_wire_us(size);
+    size_t fifo = size < UART_HW_FIFO_LEN(port) ? size : UART_HW_FIFO_LEN(port);
+    host_sim_advance_to(host_uart.wire_free_us - host_uart_wire_us(fifo));
+
+    host_uart.stats.writes++;
+    host_uart.stats.bytes += size;
+    if (size > host_uart.stats.max_write) {
+        host_uart.stats.max_write = size;
+    }
+
+    size_t done = 0;
+    while (done < size) {
+        while (host_uart.rx_count == host_uart.rx_size) {
+            pthread_cond_wait(&host_uart.drained, &host_uart.lock);
+        }
+
+        size_t len = size - done;
+        len = len < HOST_UART_RX_EVENT_SIZE ? len : HOST_UART_RX_EVENT_SIZE;
+        len = len < host_uart.rx_size - host_uart.rx_count ? len : host_uart.rx_size - host_uart.rx_count;
+        for (size_t i = 0; i < len; i++) {
+            host_uart.rx[(host_uart.rx_head + host_uart.rx_count + i) % host_uart.rx_size] = data[done + i];
+        }
+        host_uart.rx_count += len;
+        done += len;
+
+        // Post outside the lock, the RX task takes it to read the bytes
+        QueueHandle_t events = host_uart.events;
+        pthread_mutex_unlock(&host_uart.lock);
+        if (events) {
+            uart_event_t event = { .type = UART_DATA, .size = len };
+            xQueueSend(events, &event, portMAX_DELAY);
+        }
+        pthread_mutex_lock(&host_uart.lock);
+    }
+    pthread_mutex_unlock(&host_uart.lock);
+
+    return (int)size;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks)
+{
+    (void)port;
+    (void)ticks;
+    pthread_mutex_lock(&host_uart.lock);
+    host_sim_advance_to(host_uart.wire_free_us);
+    pthread_mutex_unlock(&host_uart.lock);
+    return ESP_OK;
+}
+
+void host_uart_get_stats(host_uart_stats_t *stats)
+{
+    pthread_mutex_lock(&host_uart.lock);
+    *stats = host_uart.stats;
+    pthread_mutex_unlock(&host_uart.lock);
+}
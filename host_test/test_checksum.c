@@ -0,0 +1,110 @@
+/*
+ * CRC backends of components/checksum against zlib and the CRC-8 check
+ * value, and their cost over one 1024x200 BGRA background.
+ */
+
+#include "host_test.h"
+#include "checksum.h"
+#include <zlib.h>
+
+#define FRAME_SIZE (1024 * 200 * 4) // One BGRA background
+
+/* The byte table loop png_transfer.c used before the checksum component */
+static uint32_t crc32_bytewise(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++) {
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+    }
+
+    crc ^= 0xFFFFFFFF;
+    while (len--) {
+        crc = (crc >> 8) ^ table[(crc ^ *buf++) & 0xFF];
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+/* zlib's crc32_z() with the checksum component's signature */
+static uint32_t crc32_zlib(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    return (uint32_t)crc32_z(crc, buf, len);
+}
+
+static int64_t time_crc32(uint32_t (*fn)(uint32_t, const uint8_t *, size_t), const uint8_t *frame)
+{
+    int64_t start = esp_timer_get_time();
+    for (int r = 0; r < HOST_TEST_BENCH_RUNS; r++) {
+        fn(CHECKSUM_CRC32_SEED, frame, FRAME_SIZE);
+    }
+    return (esp_timer_get_time() - start) / HOST_TEST_BENCH_RUNS;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint8_t check[] = "123456789";
+
+    checksum_init();
+
+    // Standard check values from a zero start: CRC-32 0xCBF43926, CRC-8/SMBUS 0xF4
+    CHECK(crc32_update(0, check, 9) == 0xCBF43926);
+    CHECK(crc32_update_rom(0, check, 9) == 0xCBF43926);
+    CHECK(crc32_update_slice8(0, check, 9) == 0xCBF43926);
+    CHECK(crc8(check, 9) == 0xF4);
+
+    // Deterministic BGRA-like pattern with an opaque alpha byte
+    uint8_t *frame = malloc(FRAME_SIZE + 8);
+    CHECK(frame);
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < FRAME_SIZE + 8; i++) {
+        seed = seed * 1103515245 + 12345;
+        frame[i] = ((i & 3) == 3) ? 0xFF : (uint8_t)(seed >> 16);
+    }
+
+    // Chains start from CHECKSUM_CRC32_SEED like zlib's crc32(), the STM32 compares these values
+    // Every alignment and length around the word loop, as one call and chained
+    for (size_t ofs = 0; ofs < 8; ofs++) {
+        for (size_t len = 0; len < 64; len++) {
+            uint32_t expected = crc32(CHECKSUM_CRC32_SEED, frame + ofs, len);
+            CHECK(crc32_update_slice8(CHECKSUM_CRC32_SEED, frame + ofs, len) == expected);
+            CHECK(crc32_update_rom(CHECKSUM_CRC32_SEED, frame + ofs, len) == expected);
+
+            uint32_t chained = crc32_update_slice8(CHECKSUM_CRC32_SEED, frame + ofs, len / 3);
+            chained = crc32_update_slice8(chained, frame + ofs + len / 3, len - len / 3);
+            CHECK(chained == expected);
+        }
+    }
+
+    // A background row by row through the backend checksum_init() picked
+    uint32_t expected = crc32(CHECKSUM_CRC32_SEED, frame + 1, FRAME_SIZE);
+    uint32_t crc = crc32_update(CHECKSUM_CRC32_SEED, frame + 1, 100);
+    for (size_t ofs = 100; ofs < FRAME_SIZE; ofs += 4096) {
+        size_t len = FRAME_SIZE - ofs < 4096 ? FRAME_SIZE - ofs : 4096;
+        crc = crc32_update(crc, frame + 1 + ofs, len);
+    }
+    CHECK(crc == expected);
+    CHECK(crc32_update(CHECKSUM_CRC32_SEED, frame, FRAME_SIZE) == crc32(CHECKSUM_CRC32_SEED, frame, FRAME_SIZE));
+
+    if (host_test_bench_mode(argc, argv)) {
+        printf("CRC32 over %d bytes: byte table %lld us, slice-8 %lld us, zlib %lld us\n", FRAME_SIZE,
+               (long long)time_crc32(crc32_bytewise, frame),
+               (long long)time_crc32(crc32_update_slice8, frame),
+               (long long)time_crc32(crc32_zlib, frame));
+
+        int64_t start = esp_timer_get_time();
+        for (int r = 0; r < HOST_TEST_BENCH_RUNS; r++) {
+            crc8(frame, FRAME_SIZE);
+        }
+        printf("CRC8 over %d bytes: table %lld us\n", FRAME_SIZE,
+               (long long)((esp_timer_get_time() - start) / HOST_TEST_BENCH_RUNS));
+        printf("The ROM backend only exists on target, checksum_init() times it there at startup\n");
+    }
+
+    free(frame);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * ke_sched.c handing the UART loopback between a background send and a
+ * config request, built once as is and once with CONFIG_ESP32_STM32_BULK_PREEMPT:
+ * how long the config request waits for the link, in simulated time, when
+ * it arrives while an 800 KB bulk frame is on the wire.
+ */
+
+#include "host_test.h"
+#include "host_sim.h"
+#include "ke_sched.h"
+#include "ke_txn.h"
+#include "stm32_link.h"
+#include "stm32_uart.h"
+#include "freertos/semphr.h"
+#include <unistd.h>
+
+#ifdef CONFIG_ESP32_STM32_BULK_PREEMPT
+#define MODE_NAME "preempt"
+#else
+#define MODE_NAME "whole frame"
+#endif
+
+#define FRAME_SIZE      (1024 * 200 * 4) // One BGRA background
+#define CONFIG_SIZE     2048             // A config JSON
+#define STM32_DMA_MAX   0x7FFF           // STM32_TX_MAX_CHUNK_SIZE in stm32_uart.c
+#define CHUNK_DELAY_US  250000           // STM32_TX_CHUNK_DELAY_TICKS at 100 Hz
+#define CUT_IN_CHUNK    3                // The config request arrives before this chunk of the frame
+
+struct ke_packet_manager {
+    int unused;
+};
+
+static struct ke_packet_manager link_dev;
+static uint8_t *bulk_frame;
+static uint8_t *config_frame;
+
+static SemaphoreHandle_t config_start;
+static SemaphoreHandle_t config_done;
+static int bulk_chunk;          // UART chunk of the current bulk frame about to go out
+static bool cut_in_done;
+static int64_t cut_in_us;       // Simulated time the config request was made
+static int64_t config_sent_us;  // Simulated time its frame started
+static int bulk_sends;
+static size_t bulk_last_sent;
+
+/* The KE library and ke_txn/stm32_link stand-ins, only what ke_sched_request() calls */
+void KE_Add_UART_Byte(PKE_PACKET_MANAGER dev, uint8_t byte)
+{
+    (void)dev;
+    (void)byte;
+}
+
+bool ke_txn_wait_idle(uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    return true;
+}
+
+void stm32_link_wait_begin(uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+}
+
+void stm32_link_wait_end(void)
+{
+}
+
+void stm32_link_note_timeout(void)
+{
+}
+
+KE_STATUS KE_wait_for_response(PKE_PACKET_MANAGER dev, uint32_t timeout_ms)
+{
+    (void)dev;
+    (void)timeout_ms;
+    return KE_ACK;
+}
+
+/* Polled between bulk chunks like stm32_tx() does, the config request is made at CUT_IN_CHUNK */
+static bool bulk_stop(void)
+{
+    if (++bulk_chunk == CUT_IN_CHUNK && !cut_in_done) {
+        cut_in_done = true;
+        cut_in_us = host_sim_time_us();
+        xSemaphoreGive(config_start);
+
+        // Go on only once the request is queued for the link
+        for (;;) {
+            ke_sched_class_stats_t stats[KE_SCHED_CLASS_COUNT];
+            ke_sched_get_stats(stats);
+            if (stats[KE_SCHED_CONFIG].depth > 0) {
+                break;
+            }
+            usleep(100);
+        }
+    }
+    return ke_sched_tx_should_stop();
+}
+
+/* Sends the frame for @p cmd the way stm32_tx() would, without LZ4 */
+void Generate_TX_Message(PKE_PACKET_MANAGER dev, KE_CP_OP_CODES cmd, void *args)
+{
+    (void)dev;
+    (void)args;
+
+    if (cmd == KE_BACKGROUND_SEND) {
+        bulk_sends++;
+        bulk_chunk = 0;
+        bulk_last_sent = stm32_uart_write_preemptible(bulk_frame, FRAME_SIZE, bulk_stop);
+    } else {
+        config_sent_us = host_sim_time_us();
+        CHECK(stm32_uart_write(config_frame, CONFIG_SIZE) == CONFIG_SIZE);
+    }
+}
+
+static void config_task(void *arg)
+{
+    (void)arg;
+    xSemaphoreTake(config_start, portMAX_DELAY);
+    CHECK(ke_sched_request(&link_dev, KE_SCHED_CONFIG, KE_CONFIG_SEND, NULL, 2500) == KE_ACK);
+    xSemaphoreGive(config_done);
+    vTaskDelete(NULL);
+}
+
+static int64_t wire_us(size_t len)
+{
+    // 8E1: start, 8 data, parity, stop
+    return (int64_t)len * 11 * 1000000 / STM32_UART_BASE_BAUD;
+}
+
+int main(int argc, char **argv)
+{
+    bulk_frame = malloc(FRAME_SIZE);
+    config_frame = malloc(CONFIG_SIZE);
+    CHECK(bulk_frame && config_frame);
+    memset(bulk_frame, 0x5A, FRAME_SIZE);
+    memset(config_frame, '{', CONFIG_SIZE);
+
+    uart_init(NULL);
+    ke_sched_init();
+    config_start = xSemaphoreCreateCounting(1, 0);
+    config_done = xSemaphoreCreateCounting(1, 0);
+    CHECK(xTaskCreate(config_task, "config", 4096, NULL, 5, NULL) == pdPASS);
+
+    int view = 0;
+    CHECK(ke_sched_request(&link_dev, KE_SCHED_BULK, KE_BACKGROUND_SEND, &view, 30000) == KE_ACK);
+    CHECK(xSemaphoreTake(config_done, portMAX_DELAY));
+    CHECK(cut_in_done);
+    CHECK(bulk_last_sent == FRAME_SIZE);
+
+    ke_sched_class_stats_t stats[KE_SCHED_CLASS_COUNT];
+    ke_sched_get_stats(stats);
+    CHECK(stats[KE_SCHED_CONFIG].requests == 1);
+    CHECK(stats[KE_SCHED_BULK].retries == 0);
+
+    int64_t waited = config_sent_us - cut_in_us;
+    CHECK(waited >= 0);
+    size_t rest = FRAME_SIZE - (size_t)(CUT_IN_CHUNK - 1) * STM32_DMA_MAX;
+#ifdef CONFIG_ESP32_STM32_BULK_PREEMPT
+    // The frame is cut before its next chunk, only the resync gap is left to wait
+    CHECK(waited < CHUNK_DELAY_US);
+    CHECK(bulk_sends == 2);
+    CHECK(stats[KE_SCHED_BULK].preempts == 1);
+#else
+    // The rest of the frame goes out first
+    CHECK(waited >= wire_us(rest));
+    CHECK(bulk_sends == 1);
+    CHECK(stats[KE_SCHED_BULK].preempts == 0);
+#endif
+
+    if (host_test_bench_mode(argc, argv)) {
+        printf("%-11s: config request waited %5lld ms for the link, %lu B of the background left "
+               "(wire alone %lld ms), background sent %d time(s) in %lld ms\n",
+               MODE_NAME, (long long)(waited / 1000), (unsigned long)rest,
+               (long long)(wire_us(rest) / 1000), bulk_sends, (long long)(host_sim_time_us() / 1000));
+    }
+
+    free(bulk_frame);
+    free(config_frame);
+    return 0;
+}
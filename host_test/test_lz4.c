@@ -0,0 +1,237 @@
+/*
+ * The compressed STM32 link format: every packed frame unpacks to the
+ * original through an independent decoder of the block format, and never
+ * exceeds stm32_lz4_bound().
+ */
+
+#include "host_test.h"
+#include "stm32_lz4.h"
+#include "png_decoder.h"
+#include "png_transfer.h"
+#include "checksum.h"
+
+#define FRAME_SIZE   (1024 * 200 * 4) // One BGRA background
+#define LINK_BAUD    921600
+#define LINK_BITS    11               // 8E1, start + 8 data + parity + stop
+
+/* One LZ4 block into @p dst, returns the raw length or -1 on a malformed block */
+static int32_t unpack_block(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+
+        uint32_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= end) {
+                    return -1;
+                }
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if ((uint32_t)(end - ip) < lit || (uint32_t)(dst + cap - op) < lit) {
+            return -1;
+        }
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+
+        // The last sequence is literals only
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst)) {
+            return -1;
+        }
+
+        uint32_t match = token & 15;
+        if (match == 15) {
+            uint8_t b;
+            do {
+                if (ip >= end) {
+                    return -1;
+                }
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += 4;
+        if ((uint32_t)(dst + cap - op) < match) {
+            return -1;
+        }
+        // Byte by byte, matches may overlap their own output
+        for (uint32_t i = 0; i < match; i++, op++) {
+            *op = *(op - offset);
+        }
+    }
+
+    return op - dst;
+}
+
+/* A whole packed frame, returns the raw length or -1 */
+static int32_t unpack(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+    if (len < 5 || src[0] != STM32_LZ4_MAGIC) {
+        return -1;
+    }
+    uint32_t raw_len = src[1] | (src[2] << 8) | (src[3] << 16) | ((uint32_t)src[4] << 24);
+    if (raw_len > cap) {
+        return -1;
+    }
+
+    const uint8_t *ip = src + 5;
+    const uint8_t *end = src + len;
+    uint32_t out = 0;
+    while (out < raw_len) {
+        if (end - ip < 2) {
+            return -1;
+        }
+        uint16_t header = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        uint32_t block = (raw_len - out < STM32_LZ4_BLOCK_SIZE) ? raw_len - out : STM32_LZ4_BLOCK_SIZE;
+        uint32_t payload = header & ~STM32_LZ4_STORED;
+        if ((uint32_t)(end - ip) < payload) {
+            return -1;
+        }
+        if (header & STM32_LZ4_STORED) {
+            if (payload != block) {
+                return -1;
+            }
+            memcpy(dst + out, ip, block);
+        } else if (payload >= block || unpack_block(ip, payload, dst + out, block) != (int32_t)block) {
+            // A compressed block that did not shrink should have been stored
+            return -1;
+        }
+        ip += payload;
+        out += block;
+    }
+
+    return ip == end ? (int32_t)raw_len : -1;
+}
+
+/* Pack and unpack @p data, returns the packed length */
+static uint32_t round_trip(const uint8_t *data, uint32_t len)
+{
+    uint32_t bound = stm32_lz4_bound(len);
+    uint8_t *packed = malloc(bound);
+    uint8_t *raw = malloc(len ? len : 1);
+    CHECK(packed && raw);
+
+    uint32_t packed_len = stm32_lz4_pack(data, len, packed, bound);
+    CHECK(packed_len > 0 && packed_len <= bound);
+    CHECK(unpack(packed, packed_len, raw, len) == (int32_t)len);
+    CHECK(memcmp(raw, data, len) == 0);
+
+    // Too small an output buffer is refused rather than overrun
+    CHECK(stm32_lz4_pack(data, len, packed, bound - 1) == 0);
+
+    free(packed);
+    free(raw);
+    return packed_len;
+}
+
+static void check_synthetic(void)
+{
+    static const uint32_t sizes[] = {
+        0, 1, 4, 12, 13, 255, 4095, 4096, 4097, 8191, 8192, 8193, 70000,
+    };
+    uint8_t *buf = malloc(70000);
+    CHECK(buf);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t len = sizes[i];
+
+        memset(buf, 0, len);
+        uint32_t zero = round_trip(buf, len);
+        if (len >= STM32_LZ4_BLOCK_SIZE) {
+            CHECK(zero < len / 16);
+        }
+
+        srand(len);
+        for (uint32_t j = 0; j < len; j++) {
+            buf[j] = (uint8_t)rand();
+        }
+        // Noise cannot shrink, every block is stored and the bound is met exactly
+        CHECK(round_trip(buf, len) == stm32_lz4_bound(len));
+
+        // Runs and repeats mixed with noise exercise long literals and overlapping matches
+        for (uint32_t j = 0; j < len; j++) {
+            buf[j] = (j % 300 < 150) ? (uint8_t)(j % 3) : (uint8_t)rand();
+        }
+        round_trip(buf, len);
+    }
+
+    free(buf);
+}
+
+static void report(const char *name, const uint8_t *data, uint32_t len, bool bench)
+{
+    uint32_t packed_len = round_trip(data, len);
+    if (!bench) {
+        return;
+    }
+
+    uint32_t bound = stm32_lz4_bound(len);
+    uint8_t *packed = malloc(bound);
+    CHECK(packed);
+    int64_t start = esp_timer_get_time();
+    for (int r = 0; r < HOST_TEST_BENCH_RUNS; r++) {
+        stm32_lz4_pack(data, len, packed, bound);
+    }
+    int64_t us = (esp_timer_get_time() - start) / HOST_TEST_BENCH_RUNS;
+    free(packed);
+
+    double wire_raw = (double)len * LINK_BITS * 1000.0 / LINK_BAUD;
+    double wire_packed = (double)packed_len * LINK_BITS * 1000.0 / LINK_BAUD;
+    printf("%s: %lu -> %lu B (%.1f%%), pack %lld us, wire at %d 8E1 %.0f -> %.0f ms\n", name,
+           (unsigned long)len, (unsigned long)packed_len, 100.0 * packed_len / (len ? len : 1),
+           (long long)us, LINK_BAUD, wire_raw, wire_packed);
+}
+
+int main(int argc, char **argv)
+{
+    bool bench = host_test_bench_mode(argc, argv);
+    checksum_init();
+
+    check_synthetic();
+
+    size_t len;
+    uint8_t *config = host_test_read_file("scripts/config.json", &len);
+    CHECK(config);
+    report("scripts/config.json", config, len, bench);
+    free(config);
+
+    // Backgrounds go over the link as decoded frames, not as PNG files
+    uint8_t *frame = malloc(FRAME_SIZE);
+    CHECK(frame);
+    for (int i = 1; i <= 6; i++) {
+        char rel[32];
+        snprintf(rel, sizeof(rel), "spiffs/User%d.png", i);
+        FILE *fp = fopen(host_test_path(rel), "rb");
+        CHECK(fp);
+        uint32_t crc;
+        int frame_len = decode_png_to_rgba_crc(fp, frame, FRAME_SIZE, &crc, NULL, NULL);
+        fclose(fp);
+        CHECK(frame_len > 0);
+        report(rel, frame, frame_len, bench);
+    }
+    if (bench) {
+        printf("Pack times are host times, wire times follow from the packed size\n");
+    }
+    free(frame);
+
+    return 0;
+}
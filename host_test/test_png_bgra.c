@@ -0,0 +1,137 @@
+/*
+ * BGRA output of the PNG decoders against the path it replaced: libpng
+ * decoding RGBA and a per-pixel R/B swap over the whole frame.
+ */
+
+#include "host_test.h"
+#include "png_decoder.h"
+#include "png_transfer.h"
+#include "checksum.h"
+#include "png.h"
+
+#define FRAME_SIZE (1024 * 200 * 4) // One BGRA background
+
+/* Decode to 8-bit RGBA the way png_transfer.c did before png_set_bgr */
+static int decode_rgba_reference(const char *path, uint8_t *frame, uint32_t frame_size)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png_create_info_struct(png);
+    int len = -1;
+    if (setjmp(png_jmpbuf(png))) {
+        goto out;
+    }
+
+    png_init_io(png, fp);
+    png_read_info(png, info);
+
+    png_byte color_type = png_get_color_type(png, info);
+    png_byte bit_depth = png_get_bit_depth(png, info);
+    if (bit_depth == 16) png_set_strip_16(png);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png);
+    if (png_get_valid(png, info, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png);
+    png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    png_set_gray_to_rgb(png);
+    png_read_update_info(png, info);
+
+    uint32_t height = png_get_image_height(png, info);
+    uint32_t rowbytes = png_get_rowbytes(png, info);
+    if ((uint64_t)rowbytes * height > frame_size) {
+        goto out;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        png_read_row(png, frame + (size_t)y * rowbytes, NULL);
+    }
+    len = rowbytes * height;
+
+out:
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(fp);
+    return len;
+}
+
+/* The per-pixel swap the decoders ran after libpng */
+static void swizzle_bytes(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i + 3 < len; i += 4) {
+        uint8_t tmp = buf[i];
+        buf[i] = buf[i + 2];
+        buf[i + 2] = tmp;
+    }
+}
+
+static int decode_with(const png_decoder_t *decoder, const char *path, uint8_t *frame)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+    png_decode_job_t job = { .frame = frame, .frame_size = FRAME_SIZE, .format = BG_FORMAT_BGRA8888 };
+    png_decode_status_t status = decoder->decode(fp, &job);
+    fclose(fp);
+    return status == PNG_DECODE_OK ? (int)job.len : -1;
+}
+
+int main(int argc, char **argv)
+{
+    bool bench = host_test_bench_mode(argc, argv);
+    checksum_init();
+    uint8_t *expected = malloc(FRAME_SIZE);
+    uint8_t *frame = malloc(FRAME_SIZE);
+    CHECK(expected && frame);
+
+    for (int i = 1; i <= 6; i++) {
+        char rel[32];
+        snprintf(rel, sizeof(rel), "spiffs/User%d.png", i);
+        char path[512];
+        snprintf(path, sizeof(path), "%s", host_test_path(rel));
+
+        int len = decode_rgba_reference(path, expected, FRAME_SIZE);
+        CHECK(len > 0);
+        swizzle_bytes(expected, len);
+
+        // Both backends must emit the same bytes the old swap produced
+        CHECK(decode_with(&png_decoder_libpng, path, frame) == len);
+        CHECK(memcmp(frame, expected, len) == 0);
+
+        FILE *fp = fopen(path, "rb");
+        CHECK(decode_png_to_rgba(fp, frame, FRAME_SIZE) == len);
+        fclose(fp);
+        CHECK(memcmp(frame, expected, len) == 0);
+
+        if (!bench) {
+            continue;
+        }
+
+        int64_t start = esp_timer_get_time();
+        for (int r = 0; r < HOST_TEST_BENCH_RUNS; r++) {
+            decode_rgba_reference(path, frame, FRAME_SIZE);
+            swizzle_bytes(frame, len);
+        }
+        int64_t old_us = (esp_timer_get_time() - start) / HOST_TEST_BENCH_RUNS;
+
+        start = esp_timer_get_time();
+        for (int r = 0; r < HOST_TEST_BENCH_RUNS; r++) {
+            swizzle_bytes(frame, len);
+        }
+        int64_t swap_us = (esp_timer_get_time() - start) / HOST_TEST_BENCH_RUNS;
+
+        start = esp_timer_get_time();
+        for (int r = 0; r < HOST_TEST_BENCH_RUNS; r++) {
+            decode_with(&png_decoder_libpng, path, frame);
+        }
+        int64_t bgr_us = (esp_timer_get_time() - start) / HOST_TEST_BENCH_RUNS;
+
+        printf("%s: RGBA + swap %lld us (swap alone %lld us), png_set_bgr %lld us\n",
+               rel, (long long)old_us, (long long)swap_us, (long long)bgr_us);
+    }
+
+    free(expected);
+    free(frame);
+    return 0;
+}
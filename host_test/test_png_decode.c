@@ -0,0 +1,196 @@
+/*
+ * The fast PNG backend against libpng: identical frames and CRCs on the
+ * stock backgrounds, also into misaligned frames, and a libpng fallback for
+ * every image it turns down.
+ */
+
+#include "host_test.h"
+#include "png_decoder.h"
+#include "png_transfer.h"
+#include "checksum.h"
+#include "png.h"
+#include <unistd.h>
+
+#define FRAME_SIZE (1024 * 200 * 4) // One BGRA background
+
+static png_decode_status_t decode_file(const png_decoder_t *decoder, const char *path, uint8_t *frame,
+                                       png_decode_job_t *job)
+{
+    FILE *fp = fopen(path, "rb");
+    CHECK(fp);
+    *job = (png_decode_job_t){ .frame = frame, .frame_size = FRAME_SIZE, .format = BG_WIRE_FORMAT, .want_crc = true };
+    png_decode_status_t status = decoder->decode(fp, job);
+    fclose(fp);
+    return status;
+}
+
+/* Frames inside tx_buffer start after the KE header, decode at every misalignment */
+static void check_unaligned(const char *path, const uint8_t *expected, const png_decode_job_t *expected_job)
+{
+    uint8_t *buf = malloc(FRAME_SIZE + 4);
+    CHECK(buf);
+    for (size_t ofs = 1; ofs < 4; ofs++) {
+        png_decode_job_t job;
+        CHECK(decode_file(&png_decoder_fast, path, buf + ofs, &job) == PNG_DECODE_OK);
+        CHECK(job.len == expected_job->len && job.crc == expected_job->crc);
+        CHECK(memcmp(buf + ofs, expected, job.len) == 0);
+    }
+    free(buf);
+}
+
+/* Write a small test image with libpng, @p interlace selects Adam7 */
+static void write_png(const char *path, int color_type, int bit_depth, bool interlace)
+{
+    enum { W = 37, H = 11 };
+    FILE *fp = fopen(path, "wb");
+    CHECK(fp);
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png_create_info_struct(png);
+    CHECK(png && info && !setjmp(png_jmpbuf(png)));
+    png_init_io(png, fp);
+    png_set_IHDR(png, info, W, H, bit_depth, color_type,
+                 interlace ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_color palette[4] = { {0, 0, 0}, {255, 0, 0}, {0, 255, 0}, {0, 0, 255} };
+        png_set_PLTE(png, info, palette, 4);
+    }
+    png_write_info(png, info);
+    if (bit_depth == 16) {
+        png_set_swap(png);
+    }
+
+    png_byte row[W * 8];
+    int passes = png_set_interlace_handling(png);
+    for (int pass = 0; pass < passes; pass++) {
+        for (int y = 0; y < H; y++) {
+            for (size_t i = 0; i < sizeof(row); i++) {
+                row[i] = (png_byte)(i * 7 + y * 13);
+            }
+            if (color_type == PNG_COLOR_TYPE_PALETTE) {
+                for (int x = 0; x < W; x++) {
+                    row[x] = (png_byte)((x + y) & 3);
+                }
+            }
+            png_write_row(png, row);
+        }
+    }
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    fclose(fp);
+}
+
+static void check_stock_backgrounds(bool bench, uint8_t *a, uint8_t *b)
+{
+    for (int i = 1; i <= 6; i++) {
+        char rel[32];
+        snprintf(rel, sizeof(rel), "spiffs/User%d.png", i);
+        char path[512];
+        snprintf(path, sizeof(path), "%s", host_test_path(rel));
+
+        png_decode_job_t ja, jb;
+        CHECK(decode_file(&png_decoder_libpng, path, a, &ja) == PNG_DECODE_OK);
+        CHECK(decode_file(&png_decoder_fast, path, b, &jb) == PNG_DECODE_OK);
+        CHECK(ja.len == jb.len && ja.width == jb.width && ja.height == jb.height);
+        CHECK(memcmp(a, b, ja.len) == 0);
+        CHECK(ja.crc == jb.crc);
+        CHECK(ja.crc == crc32_update(CHECKSUM_CRC32_SEED, a, ja.len));
+        check_unaligned(path, a, &ja);
+
+        FILE *fp = fopen(path, "rb");
+        CHECK(crc32_png_rgba(fp, NULL, NULL) == ja.crc);
+        fclose(fp);
+
+        if (!bench) {
+            continue;
+        }
+
+        int64_t us[2];
+        const png_decoder_t *decoders[2] = { &png_decoder_libpng, &png_decoder_fast };
+        for (int d = 0; d < 2; d++) {
+            int64_t start = esp_timer_get_time();
+            for (int r = 0; r < HOST_TEST_BENCH_RUNS; r++) {
+                decode_file(decoders[d], path, a, &ja);
+            }
+            us[d] = (esp_timer_get_time() - start) / HOST_TEST_BENCH_RUNS;
+        }
+        printf("%s %lux%lu: libpng %lld us, fast %lld us\n", rel, (unsigned long)ja.width,
+               (unsigned long)ja.height, (long long)us[0], (long long)us[1]);
+    }
+}
+
+static void check_fallbacks(uint8_t *a, uint8_t *b)
+{
+    static const struct {
+        int color_type;
+        int bit_depth;
+        bool interlace;
+        bool fast;          // Handled by the fast backend itself
+    } cases[] = {
+        { PNG_COLOR_TYPE_RGB,       8,  false, true  },
+        { PNG_COLOR_TYPE_RGB_ALPHA, 8,  false, true  },
+        { PNG_COLOR_TYPE_RGB,       8,  true,  false },
+        { PNG_COLOR_TYPE_RGB_ALPHA, 16, false, false },
+        { PNG_COLOR_TYPE_GRAY,      8,  false, false },
+        { PNG_COLOR_TYPE_PALETTE,   2,  false, false },
+    };
+
+    char path[] = "/tmp/ke_host_png_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        write_png(path, cases[i].color_type, cases[i].bit_depth, cases[i].interlace);
+
+        png_decode_job_t ja, jb;
+        CHECK(decode_file(&png_decoder_libpng, path, a, &ja) == PNG_DECODE_OK);
+        CHECK(decode_file(&png_decoder_fast, path, b, &jb) ==
+              (cases[i].fast ? PNG_DECODE_OK : PNG_DECODE_UNSUPPORTED));
+        if (cases[i].fast) {
+            CHECK(ja.len == jb.len && memcmp(a, b, ja.len) == 0 && ja.crc == jb.crc);
+            check_unaligned(path, a, &ja);
+        }
+
+        // The public entry point falls back to libpng and gives its frame
+        FILE *fp = fopen(path, "rb");
+        uint32_t crc = 0;
+        CHECK(decode_png_to_rgba_crc(fp, b, FRAME_SIZE, &crc, NULL, NULL) == (int)ja.len);
+        fclose(fp);
+        CHECK(memcmp(a, b, ja.len) == 0 && crc == ja.crc);
+    }
+
+    // A truncated image fails in both backends rather than returning a partial frame
+    size_t len;
+    uint8_t *data = host_test_read_file("spiffs/User1.png", &len);
+    CHECK(data);
+    FILE *fp = fopen(path, "wb");
+    fwrite(data, 1, len / 2, fp);
+    fclose(fp);
+    free(data);
+
+    png_decode_job_t job;
+    CHECK(decode_file(&png_decoder_fast, path, b, &job) == PNG_DECODE_ERROR);
+    CHECK(decode_file(&png_decoder_libpng, path, b, &job) == PNG_DECODE_ERROR);
+
+    close(fd);
+    unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    checksum_init();
+    uint8_t *a = malloc(FRAME_SIZE);
+    uint8_t *b = malloc(FRAME_SIZE);
+    CHECK(a && b);
+
+    check_fallbacks(a, b);
+    check_stock_backgrounds(host_test_bench_mode(argc, argv), a, b);
+    if (host_test_bench_mode(argc, argv)) {
+        printf("The host fast backend inflates with zlib in place of the ROM tinfl\n");
+    }
+
+    free(a);
+    free(b);
+    return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * The UART RX ring: span bookkeeping across the wrap, a two-thread
+ * producer/consumer stream, and the cost per received byte of the old
+ * byte-at-a-time driver reads against draining whole spans into the ring.
+ */
+
+#include "host_test.h"
+#include "ring_buffer.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/param.h>
+
+#define STREAM_BYTES   (16 * 1024 * 1024)
+#define RX_EVENT_SIZE  120               // UART_DATA size at the driver's default RX full threshold
+#define RX_TOTAL       (1024 * 200 * 4)  // One background worth of reply bytes
+#define RX_RING_SIZE   8192              // CONFIG_ESP32_STM32_UART_RX_RING_SIZE default
+
+static void check_spans(void)
+{
+    uint8_t storage[16];
+    ring_buffer_t rb;
+
+    CHECK(!ring_buffer_init(&rb, storage, 0));
+    CHECK(!ring_buffer_init(&rb, storage, 12));
+    CHECK(!ring_buffer_init(&rb, NULL, 16));
+    CHECK(ring_buffer_init(&rb, storage, sizeof(storage)));
+
+    uint8_t *wspan;
+    const uint8_t *rspan;
+    CHECK(ring_buffer_read_span(&rb, &rspan) == 0);
+    CHECK(ring_buffer_write_span(&rb, &wspan) == 16 && wspan == storage);
+
+    // Move both indices to 12, the next write span stops at the end of storage
+    ring_buffer_commit(&rb, 12);
+    CHECK(ring_buffer_used(&rb) == 12);
+    CHECK(ring_buffer_read_span(&rb, &rspan) == 12 && rspan == storage);
+    ring_buffer_consume(&rb, 12);
+    CHECK(ring_buffer_used(&rb) == 0);
+
+    CHECK(ring_buffer_write_span(&rb, &wspan) == 4 && wspan == storage + 12);
+    memcpy(wspan, "abcd", 4);
+    ring_buffer_commit(&rb, 4);
+    CHECK(ring_buffer_write_span(&rb, &wspan) == 12 && wspan == storage);
+    memcpy(wspan, "efghijkl", 8);
+    ring_buffer_commit(&rb, 8);
+
+    // The free span is limited by the unread tail, not the end of storage
+    CHECK(ring_buffer_write_span(&rb, &wspan) == 4 && wspan == storage + 8);
+    CHECK(ring_buffer_used(&rb) == 12);
+
+    CHECK(ring_buffer_read_span(&rb, &rspan) == 4 && memcmp(rspan, "abcd", 4) == 0);
+    ring_buffer_consume(&rb, 4);
+    CHECK(ring_buffer_read_span(&rb, &rspan) == 8 && memcmp(rspan, "efghijkl", 8) == 0);
+    ring_buffer_consume(&rb, 3);
+    CHECK(ring_buffer_read_span(&rb, &rspan) == 5 && rspan[0] == 'h');
+
+    // Full ring: no write span at all
+    ring_buffer_reset(&rb);
+    CHECK(ring_buffer_write_span(&rb, &wspan) == 16);
+    ring_buffer_commit(&rb, 16);
+    CHECK(ring_buffer_write_span(&rb, &wspan) == 0);
+    CHECK(ring_buffer_used(&rb) == 16);
+}
+
+/* Byte n of the test stream, a period that does not divide the ring size */
+static inline uint8_t stream_byte(uint32_t n)
+{
+    return (uint8_t)(n % 251);
+}
+
+static void *stream_producer(void *arg)
+{
+    ring_buffer_t *rb = arg;
+    uint32_t sent = 0;
+    uint32_t rng = 1;
+
+    while (sent < STREAM_BYTES) {
+        uint8_t *span;
+        size_t room = ring_buffer_write_span(rb, &span);
+        if (room == 0) {
+            sched_yield();
+            continue;
+        }
+
+        // Short and long writes, like UART_DATA events of any size
+        rng = rng * 1103515245 + 12345;
+        size_t len = 1 + (rng >> 16) % 97;
+        len = MIN(len, room);
+        len = MIN(len, (size_t)(STREAM_BYTES - sent));
+        for (size_t i = 0; i < len; i++) {
+            span[i] = stream_byte(sent + i);
+        }
+        ring_buffer_commit(rb, len);
+        sent += len;
+    }
+    return NULL;
+}
+
+static void check_stream(void)
+{
+    static uint8_t storage[256];
+    ring_buffer_t rb;
+    CHECK(ring_buffer_init(&rb, storage, sizeof(storage)));
+
+    pthread_t producer;
+    CHECK(pthread_create(&producer, NULL, stream_producer, &rb) == 0);
+
+    uint32_t received = 0;
+    while (received < STREAM_BYTES) {
+        const uint8_t *span;
+        size_t len = ring_buffer_read_span(&rb, &span);
+        CHECK(ring_buffer_used(&rb) <= sizeof(storage));
+        if (len == 0) {
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < len; i++) {
+            CHECK(span[i] == stream_byte(received + i));
+        }
+        ring_buffer_consume(&rb, len);
+        received += len;
+    }
+
+    pthread_join(producer, NULL);
+    CHECK(ring_buffer_used(&rb) == 0);
+}
+
+/*
+ * Stand-in for the UART driver's RX buffer. Every uart_read_bytes() call
+ * takes the driver's RX lock and copies out of its ring, whatever the length.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    const uint8_t *data;
+    size_t pos;
+    size_t end;
+} fake_uart_t;
+
+static __attribute__((noinline)) int fake_uart_read(fake_uart_t *uart, uint8_t *buf, size_t len)
+{
+    pthread_mutex_lock(&uart->lock);
+    len = MIN(len, uart->end - uart->pos);
+    memcpy(buf, uart->data + uart->pos, len);
+    uart->pos += len;
+    pthread_mutex_unlock(&uart->lock);
+    return (int)len;
+}
+
+/* Stand-in for KE_Add_UART_Byte(), the parser is fed one byte at a time either way */
+static uint32_t parsed_sum;
+
+static __attribute__((noinline)) void fake_parser_byte(uint8_t b)
+{
+    parsed_sum = parsed_sum * 31 + b;
+}
+
+/* The RX task before the ring: one driver read per byte of each UART_DATA event */
+static void rx_per_byte(fake_uart_t *uart)
+{
+    for (size_t event = 0; event < RX_TOTAL; event += RX_EVENT_SIZE) {
+        uart->end = MIN(event + RX_EVENT_SIZE, (size_t)RX_TOTAL);
+        uint8_t b;
+        while (fake_uart_read(uart, &b, 1) == 1) {
+            fake_parser_byte(b);
+        }
+    }
+}
+
+/* uart_drain_to_ring() and uart_parse_task() run back to back per event */
+static void rx_spans(fake_uart_t *uart, ring_buffer_t *rb)
+{
+    for (size_t event = 0; event < RX_TOTAL; event += RX_EVENT_SIZE) {
+        uart->end = MIN(event + RX_EVENT_SIZE, (size_t)RX_TOTAL);
+
+        size_t pending = uart->end - uart->pos;
+        while (pending > 0) {
+            uint8_t *span;
+            size_t room = ring_buffer_write_span(rb, &span);
+            int len = fake_uart_read(uart, span, MIN(room, pending));
+            ring_buffer_commit(rb, len);
+            pending -= len;
+        }
+
+        const uint8_t *span;
+        size_t len;
+        while ((len = ring_buffer_read_span(rb, &span)) > 0) {
+            for (size_t i = 0; i < len; i++) {
+                fake_parser_byte(span[i]);
+            }
+            ring_buffer_consume(rb, len);
+        }
+    }
+}
+
+static void bench_rx(bool bench)
+{
+    uint8_t *data = malloc(RX_TOTAL);
+    CHECK(data);
+    for (size_t i = 0; i < RX_TOTAL; i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+    static uint8_t storage[RX_RING_SIZE];
+    ring_buffer_t rb;
+    CHECK(ring_buffer_init(&rb, storage, sizeof(storage)));
+
+    fake_uart_t uart = { .data = data };
+    pthread_mutex_init(&uart.lock, NULL);
+
+    // Both paths hand the parser the same bytes in the same order
+    uint32_t sums[2];
+    int64_t us[2];
+    for (int path = 0; path < 2; path++) {
+        int64_t start = esp_timer_get_time();
+        int runs = bench ? HOST_TEST_BENCH_RUNS : 1;
+        for (int r = 0; r < runs; r++) {
+            uart.pos = 0;
+            parsed_sum = 0;
+            if (path == 0) {
+                rx_per_byte(&uart);
+            } else {
+                rx_spans(&uart, &rb);
+            }
+        }
+        us[path] = (esp_timer_get_time() - start) / runs;
+        sums[path] = parsed_sum;
+    }
+    CHECK(sums[0] == sums[1]);
+    CHECK(ring_buffer_used(&rb) == 0);
+
+    if (bench) {
+        printf("RX %d B in %d B events: per-byte reads %.2f ns/B, ring spans %.2f ns/B\n", RX_TOTAL,
+               RX_EVENT_SIZE, us[0] * 1000.0 / RX_TOTAL, us[1] * 1000.0 / RX_TOTAL);
+        printf("The driver stand-in is a mutex and a copy, the IDF read path also goes through a FreeRTOS ring buffer\n");
+    }
+
+    pthread_mutex_destroy(&uart.lock);
+    free(data);
+}
+
+int main(int argc, char **argv)
+{
+    check_spans();
+    check_stream();
+    bench_rx(host_test_bench_mode(argc, argv));
+    return 0;
+}
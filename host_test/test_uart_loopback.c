@@ -0,0 +1,179 @@
+/*
+ * stm32_uart.c over a TX->RX loopback, built once with the fixed TX delay
+ * and once with RTS/CTS: frames arrive intact through the RX ring and the
+ * KE parser feed, chunks stay within the STM32 DMA size, and the time each
+ * transfer takes on the simulated wire.
+ */
+
+#include "host_test.h"
+#include "host_sim.h"
+#include "stm32_uart.h"
+#include "driver/uart.h"
+#include "freertos/semphr.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef CONFIG_ESP32_STM32_UART_HW_FLOWCTRL
+#define MODE_NAME "RTS/CTS"
+#else
+#define MODE_NAME "fixed delay"
+#endif
+
+#define FRAME_SIZE      (1024 * 200 * 4) // One BGRA background
+#define STM32_DMA_MAX   0x7FFF           // STM32_TX_MAX_CHUNK_SIZE in stm32_uart.c
+#define CHUNK_DELAY_US  250000           // STM32_TX_CHUNK_DELAY_TICKS at 100 Hz
+#define RX_WAIT_US      (10 * 1000000)   // Real time allowed for the loopback to deliver
+
+/* Everything the KE parser was fed */
+static struct {
+    pthread_mutex_t lock;
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} received = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+void KE_Add_UART_Byte(PKE_PACKET_MANAGER dev, uint8_t byte)
+{
+    (void)dev;
+    pthread_mutex_lock(&received.lock);
+    if (received.len < received.cap) {
+        received.data[received.len] = byte;
+    }
+    received.len++;
+    pthread_mutex_unlock(&received.lock);
+}
+
+static void received_reset(void)
+{
+    pthread_mutex_lock(&received.lock);
+    received.len = 0;
+    pthread_mutex_unlock(&received.lock);
+}
+
+/* Wait for @p len bytes to come back and compare them with @p data */
+static void check_received(const uint8_t *data, size_t len)
+{
+    int64_t start = esp_timer_get_time();
+    for (;;) {
+        pthread_mutex_lock(&received.lock);
+        size_t got = received.len;
+        pthread_mutex_unlock(&received.lock);
+        if (got >= len) {
+            CHECK(got == len);
+            break;
+        }
+        CHECK(esp_timer_get_time() - start < RX_WAIT_US);
+        usleep(1000);
+    }
+    CHECK(memcmp(received.data, data, len) == 0);
+}
+
+static int64_t wire_us(size_t len)
+{
+    // 8E1: start, 8 data, parity, stop
+    return (int64_t)len * 11 * 1000000 / STM32_UART_BASE_BAUD;
+}
+
+/* Send one frame and return the simulated time until its last byte is out */
+static int64_t send_frame(const uint8_t *data, size_t len)
+{
+    received_reset();
+    // Start on an idle wire, an earlier async frame may have left from another task's clock
+    uart_wait_tx_done(CONFIG_ESP32_STM32_UART_CONTROLLER, portMAX_DELAY);
+    int64_t start = host_sim_time_us();
+    CHECK(stm32_uart_write(data, len) == (int)len);
+    uart_wait_tx_done(CONFIG_ESP32_STM32_UART_CONTROLLER, portMAX_DELAY);
+    int64_t elapsed = host_sim_time_us() - start;
+    check_received(data, len);
+    return elapsed;
+}
+
+static int async_sent;
+static SemaphoreHandle_t async_done_sem;
+
+static void async_done(int sent, void *arg)
+{
+    async_sent = sent;
+    xSemaphoreGive(async_done_sem);
+}
+
+static void check_link(uint8_t *frame)
+{
+    // The auto baud sync character goes out on every rate change
+    received_reset();
+    CHECK(stm32_uart_set_baud(STM32_UART_BASE_BAUD) == ESP_OK);
+    const uint8_t sync = 0x7F;
+    check_received(&sync, 1);
+
+    // A frame over several STM32 DMA chunks, the last one short
+    size_t len = 3 * STM32_DMA_MAX + 1000;
+    host_uart_stats_t before, after;
+    host_uart_get_stats(&before);
+    int64_t elapsed = send_frame(frame, len);
+    host_uart_get_stats(&after);
+    CHECK(after.writes - before.writes == 4);
+    CHECK(after.max_write <= STM32_DMA_MAX);
+
+#ifdef CONFIG_ESP32_STM32_UART_HW_FLOWCTRL
+    // Back to back chunks, only the wire time give or take a microsecond of rounding per chunk
+    CHECK(elapsed >= wire_us(len) - 4 && elapsed <= wire_us(len) + 4);
+#else
+    // Every chunk is followed by the fixed delay, the last one overlaps the FIFO drain
+    CHECK(elapsed >= wire_us(len) + 3 * CHUNK_DELAY_US);
+    CHECK(elapsed <= wire_us(len) + 4 * CHUNK_DELAY_US);
+#endif
+
+    // Async frames come out the same and report their length. The idle bit is set
+    // before done_cb runs, so the callback is waited for on its own
+    received_reset();
+    async_done_sem = xSemaphoreCreateCounting(1, 0);
+    CHECK(stm32_uart_write_async(frame, len, async_done, NULL) == ESP_OK);
+    CHECK(stm32_uart_tx_wait_done(portMAX_DELAY));
+    CHECK(xSemaphoreTake(async_done_sem, pdMS_TO_TICKS(RX_WAIT_US / 1000)));
+    CHECK(async_sent == (int)len);
+    check_received(frame, len);
+}
+
+static void bench_transfer(const char *name, const uint8_t *data, size_t len)
+{
+    int64_t elapsed = send_frame(data, len);
+    printf("%-11s %-11s: %7lu B in %5lld ms, %6llu B/s (wire alone %lld ms)\n", MODE_NAME, name,
+           (unsigned long)len, (long long)(elapsed / 1000),
+           (unsigned long long)len * 1000000ULL / (elapsed ? elapsed : 1),
+           (long long)(wire_us(len) / 1000));
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t *frame = malloc(FRAME_SIZE);
+    received.data = malloc(FRAME_SIZE);
+    received.cap = FRAME_SIZE;
+    CHECK(frame && received.data);
+    for (size_t i = 0; i < FRAME_SIZE; i++) {
+        frame[i] = (uint8_t)(i * 131 + (i >> 11));
+    }
+
+    uart_init(NULL);
+    check_link(frame);
+
+    if (host_test_bench_mode(argc, argv)) {
+        size_t len;
+        uint8_t *config = host_test_read_file("scripts/config.json", &len);
+        CHECK(config);
+        bench_transfer("config", config, len);
+        free(config);
+
+        // No option list sample in the repo, the settings list is the closest in size and shape
+        uint8_t *options = host_test_read_file("scripts/settings.json", &len);
+        CHECK(options);
+        bench_transfer("option list", options, len);
+        free(options);
+
+        bench_transfer("background", frame, FRAME_SIZE);
+        printf("Simulated %d 8E1 wire, the STM32 is assumed to keep up so CTS never stalls\n",
+               STM32_UART_BASE_BAUD);
+    }
+
+    free(frame);
+    return 0;
+}
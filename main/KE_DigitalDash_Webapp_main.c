@@ -9,6 +9,7 @@
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "esp_system.h"
@@ -26,6 +27,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
 #include "spi_flash_mmap.h"
 #include <esp_http_server.h>
 
@@ -42,9 +45,18 @@
 #include "spiffs_init.h"
 #include "stm_flash.h"
 #include "stm32_uart.h"
+#include "stm32_link.h"
+#include "stm32_lz4.h"
+#include "ke_txn.h"
+#include "ke_sched.h"
+#include "bg_manifest.h"
+#include "bg_ingest.h"
+#include "bg_format.h"
 #include "png_transfer.h"
+#include "checksum.h"
+#include "png_arena.h"
+#include "view_options.h"
 #include "lib_ke_protocol.h"
-#include "cJSON.h"
 #include "esp_heap_caps.h"
 #include "config_handler.h"
 
@@ -53,6 +65,12 @@
 
 #define CAN_STBY_GPIO GPIO_NUM_40
 
+#define DEBUG_SYNC_HEAP_STATS 0 // Log internal heap headroom and fragmentation after every sync
+
+#define MIRROR_PREPARE_CORE     1           // Views are compared here while the other core drives the link
+#define MIRROR_NAME_SIZE        VIEW_OPTIONS_PATH_SIZE
+#define MIRROR_CRC_BATCH_MS     3000        // All CRC queries of one sync together
+
 static const char *TAG = "Main";
 
 uint32_t background_crc = 0;
@@ -60,6 +78,27 @@ uint8_t background_idx = 0xFF;
 
 KE_PACKET_MANAGER stm32_comm;
 
+static SemaphoreHandle_t mirror_lock = NULL;
+static TaskHandle_t mirror_request_task_handle = NULL; // Runs the syncs asked for over HTTP
+
+// Send decisions from the prepare worker, one view ahead of the sync task
+static QueueHandle_t prepare_results = NULL;
+
+typedef struct {
+    int count;
+    char (*names)[MIRROR_NAME_SIZE]; // Empty for views without a valid background
+    uint32_t *stm32_crc;
+    bool *stm32_known;               // The STM32 answered the CRC query for this view
+} mirror_plan_t;
+
+static mirror_plan_t mirror_plan;
+
+#if CONFIG_ESP32_STM32_UART_LZ4
+// Compressed copy of the frame on the wire, guarded by ke_sched_tx_lock() like tx_buffer
+static uint8_t *tx_packed = NULL;
+static uint32_t tx_packed_size = 0;
+#endif
+
 void gpio_init(void)
 {
     gpio_config_t io_conf = {
@@ -88,6 +127,7 @@ void init_webapp_ap(void)
 
     // Initialize SPIFFS
     init_spiffs();
+    bg_manifest_init();
 
     ESP_LOGI(TAG, "Listing files in SPIFFS:");
     list_spiffs_files();
@@ -104,30 +144,28 @@ void init_webapp_ap(void)
 
 int stm32_tx(const uint8_t *data, uint32_t len)
 {
-    size_t total_sent = 0;
-    size_t max_chunk_size = 0x7FFF; // 1/2 0xFFFF which is the STM32 max DMA size
-
-    while (total_sent < len) {
-        size_t chunk = len - total_sent;
-        chunk = ( chunk > max_chunk_size ) ? (max_chunk_size) : chunk;
-        int sent = uart_write_bytes(CONFIG_ESP32_STM32_UART_CONTROLLER,
-                                    (const char *)(data + total_sent),
-                                    chunk);
-
-        if (sent < 0) {
-            ESP_LOGE("UART", "TX failed at byte %d", total_sent);
-            return total_sent;  // Return bytes sent before error
-        }
-
-        // Wait for the reciever to process data. THIS IS A MUST
-        vTaskDelay(25);
-
-        total_sent += sent;
+#if CONFIG_ESP32_STM32_UART_LZ4
+    // Called from Generate_TX_Message() and KE_Service(), both under ke_sched_tx_lock()
+    uint32_t frame_len = len;
+    len = stm32_lz4_pack(data, frame_len, tx_packed, tx_packed_size);
+    if (len == 0) {
+        ESP_LOGE(TAG, "No room to compress a %lu byte frame", (unsigned long)frame_len);
+        return 0;
     }
+    data = tx_packed;
+#endif
 
-    //ESP_LOGI(TAG, "Sent %d bytes to STM32", total_sent);
+    // Blocking, ke_sched_tx_unlock() waits for the frame to leave before tx_buffer is reused anyway.
+    // A bulk frame may stop short between chunks when a config request waits, ke_sched sends it again
+    int sent = stm32_uart_write_preemptible(data, len, ke_sched_tx_should_stop);
 
-    return total_sent;
+#if CONFIG_ESP32_STM32_UART_LZ4
+    // The KE library checks its own frame length, not what went over the wire
+    if (sent == (int)len) {
+        sent = frame_len;
+    }
+#endif
+    return sent;
 }
 
 
@@ -135,13 +173,23 @@ KE_PACKET_MANAGER *get_stm32_comm(void) {
     return &stm32_comm;
 }
 
+/* Copy a received JSON payload into its destination, returns the stored length */
+static uint32_t store_json_payload(char *dst, uint32_t max_len, const char *json_str)
+{
+    // Only the payload is touched, strncpy would zero pad the rest of the buffer
+    uint32_t len = strnlen(json_str, max_len - 1);
+    memcpy(dst, json_str, len);
+    dst[len] = '\0';
+    return len;
+}
+
 /**
  * @brief Copies the JSON configuration data into the provided buffer.
  *
- * This function safely copies the contents of `json_data_output` into
- * the given `buffer`, ensuring null termination to avoid buffer overflows
- * or unterminated strings. The function also logs the copied JSON string
- * for debugging purposes.
+ * This function copies the contents of `json_data_output` into the given
+ * `buffer` using its tracked length, ensuring null termination to avoid
+ * buffer overflows or unterminated strings. The function also logs the
+ * copied JSON string for debugging purposes.
  *
  * @param buffer        Destination buffer where JSON data will be copied.
  * @param buffer_size   Size of the destination buffer in bytes.
@@ -152,19 +200,21 @@ uint32_t send_config(char *buffer, uint32_t buffer_size)
 {
     char *ptr;
     uint32_t len;
-    get_json_data_output_info(&ptr, &len);
-    strncpy(buffer, ptr, buffer_size - 1);
-    buffer[buffer_size - 1] = '\0'; // ensure null termination
+    get_json_data_output_info(&ptr, NULL);
+    len = MIN(get_json_data_output_len(), buffer_size - 1);
+    memcpy(buffer, ptr, len);
+    buffer[len] = '\0'; // ensure null termination
 
     ESP_LOGD("CONFIG", "JSON Config copied to buffer:\n%s", buffer);
-    return strlen(buffer);
+    return len;
 }
 
 /**
  * @brief Receives and stores a JSON configuration string.
  *
- * Copies the provided JSON string into the internal `json_data_input` buffer,
- * ensuring that it is safely null-terminated to prevent buffer overflows.
+ * Copies the provided JSON string into the internal `json_data_input` buffer
+ * and records its length, ensuring that it is safely null-terminated to
+ * prevent buffer overflows.
  * The received configuration is then logged for debugging purposes.
  *
  * @param json_str  Pointer to the input JSON string.
@@ -176,19 +226,19 @@ bool receive_config(const char *json_str)
     char *ptr;
     uint32_t len;
     get_json_data_input_info(&ptr, &len);
-    strncpy(ptr, json_str, len-1);
-    ptr[len - 1] = '\0'; // ensure null termination
+    set_json_data_input_len(store_json_payload(ptr, len, json_str));
 
     ESP_LOGD("CONFIG", "Received JSON Config:\n%s", ptr);
+    ke_txn_complete(KE_TXN_CONFIG, 0, 0);
     return true;
 }
 
 /**
  * @brief Receives and stores a JSON-formatted option list.
  *
- * Copies the given JSON string into the internal `option_list` buffer,
- * ensuring it is null-terminated to avoid buffer overflows. The received
- * data is then logged for debugging purposes.
+ * Copies the given JSON string into the internal `option_list` buffer and
+ * records its length, ensuring it is null-terminated to avoid buffer overflows. The
+ * option model is rebuilt from it and the received data is then logged for debugging purposes.
  *
  * @param json_str  Pointer to the JSON string containing the option list.
  *
@@ -199,10 +249,11 @@ bool receive_option_list(const char *json_str)
     char *ptr;
     uint32_t len;
     get_option_list_info(&ptr, &len);
-    strncpy(ptr, json_str, len - 1);
-    ptr[len - 1] = '\0'; // ensure null termination
+    set_option_list_len(store_json_payload(ptr, len, json_str));
+    view_options_update(ptr);
 
     ESP_LOGD("CONFIG", "Received JSON Option List:\n%s", ptr);
+    ke_txn_complete(KE_TXN_OPTION_LIST, 0, 0);
     return true;
 }
 
@@ -211,10 +262,10 @@ bool receive_pid_list(const char *json_str)
     char *ptr;
     uint32_t len;
     get_pid_list_info(&ptr, &len);
-    strncpy(ptr, json_str, len - 1);
-    ptr[len - 1] = '\0'; // ensure null termination
+    set_pid_list_len(store_json_payload(ptr, len, json_str));
 
     ESP_LOGD("CONFIG", "Received JSON PID List:\n%s", ptr);
+    ke_txn_complete(KE_TXN_PID_LIST, 0, 0);
     return true;
 }
 
@@ -223,113 +274,350 @@ uint32_t recieve_crc_from_ke(uint8_t idx, uint32_t crc)
 {
     background_crc = crc;
     background_idx = idx;
+    ke_txn_complete(KE_TXN_BACKGROUND_CRC, idx, crc);
     return crc;
 }
 
+/**
+ * @brief Read the frame decoded when a background was uploaded.
+ *
+ * @return Number of bytes read into @p buffer, 0 if there is no usable sidecar.
+ */
+static int load_ingested_background(const char *image_name, char *buffer, uint32_t buffer_size)
+{
+    uint32_t len = 0;
+    FILE *fp = bg_ingest_open_raw(image_name, buffer_size, &len);
+    if (!fp) {
+        return 0;
+    }
+
+    size_t read = fread(buffer, 1, len, fp);
+    fclose(fp);
+    return (read == len) ? (int)len : 0;
+}
+
 uint32_t png_to_rgba(char *buffer, uint32_t buffer_size, uint8_t background_idx)
 {
     int num_bytes = 0;
 
-    char *ptr;
-    uint32_t len;
-    get_option_list_info(&ptr, &len);
-
-    // Parse the JSON string
-    cJSON *root = cJSON_Parse(ptr);
-    if (root == NULL) {
-        ESP_LOGI(TAG, "Error parsing JSON!\n");
+    view_background_t background;
+    if (!view_options_background(background_idx, &background)) {
+        ESP_LOGI(TAG, "view_background[%d] is not a valid string", background_idx);
         return num_bytes;
     }
+    const char *image_name = background.path;
+
+    // Straight into tx_buffer, the KE library builds the whole frame there before sending it
+    FILE *fp = NULL;
+    if ((num_bytes = load_ingested_background(image_name, buffer, buffer_size)) > 0) {
+        ESP_LOGI(TAG, "%s raw bytes sent (ingested)", image_name);
+    } else if ((fp = fopen(image_name, "rb")) != NULL) {
+        ESP_LOGI(TAG, "%s raw bytes sent", image_name);
+        num_bytes = decode_png_to_rgba(fp, (uint8_t*)buffer, buffer_size);
+        fclose(fp);
+    } else {
+        ESP_LOGW(TAG, "File not found: %s", image_name);
+    }
 
-    // Get the "view_background" array from the JSON object
-    cJSON *view_background = cJSON_GetObjectItemCaseSensitive(root, "view_background");
-    if (!cJSON_IsArray(view_background)) {
-        ESP_LOGI(TAG, "\"view_background\" is not an array or does not exist!");
-        cJSON_Delete(root);
-        return num_bytes;
+    return num_bytes;
+}
+
+/**
+ * @brief Compare one view with the STM32.
+ *
+ * A PNG missing from the manifest is decoded for its CRC only, no frame is
+ * kept. png_to_rgba() decodes it again into tx_buffer if it is sent.
+ *
+ * @return true if the view needs a KE_BACKGROUND_SEND.
+ */
+static bool prepare_background(int view, const mirror_plan_t *plan)
+{
+    const char *image_name = plan->names[view];
+    if (image_name[0] == '\0') {
+        ESP_LOGI(TAG, "view_background[%d] is not a valid string", view);
+        return false;
     }
 
-    // Verify the background is in bounds
-    if( background_idx >= cJSON_GetArraySize(view_background) ) {
-        cJSON_Delete(root);
-        return num_bytes;
+    // Cached per file, only decoded when the PNG changed since the last sync
+    uint32_t img_crc;
+    if (!bg_manifest_lookup(image_name, &img_crc, NULL, NULL) &&
+        !bg_manifest_get_crc(image_name, &img_crc, NULL, NULL)) {
+        ESP_LOGI(TAG, "File not found: %s", image_name);
+        return false;
     }
 
-    cJSON *user = cJSON_GetArrayItem(view_background, background_idx);
-    if (cJSON_IsString(user) && user->valuestring != NULL) {
-        char image_name[64] = {0};
-        snprintf(image_name, sizeof(image_name), "/spiffs/%s.png", user->valuestring);
-        
-        FILE *fp = fopen(image_name, "rb");
-        if (fp) {
-            ESP_LOGI(TAG, "%s raw bytes sent", image_name);
-            num_bytes = decode_png_to_rgba(fp, (uint8_t*)buffer, buffer_size);
-            fclose(fp);
-        } else {
-            ESP_LOGW(TAG, "File not found: %s", image_name);
+    ESP_LOGI(TAG, "File exists: %s", image_name);
+    ESP_LOGI(TAG, "ESP32 CRC: %lu", img_crc);
+    uint32_t stm32_crc = plan->stm32_known[view] ? plan->stm32_crc[view] : 0;
+    if (!plan->stm32_known[view]) {
+        ESP_LOGW(TAG, "No CRC from STM32 for view %d", view);
+    }
+    ESP_LOGI(TAG, "STM32 CRC: %lu", stm32_crc);
+    if (stm32_crc == img_crc) {
+        ESP_LOGI(TAG, "Image match, skipping");
+        return false;
+    }
+
+    return true;
+}
+
+/* Compares each view in turn on the other core, one ahead of the send loop */
+static void mirror_prepare_task(void *arg)
+{
+    const mirror_plan_t *plan = (const mirror_plan_t *)arg;
+    int count = plan->count; // The plan is freed once the last result is taken
+
+    for (int i = 0; i < count; i++) {
+        bool send = prepare_background(i, plan);
+        xQueueSend(prepare_results, &send, portMAX_DELAY);
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void mirror_plan_free(mirror_plan_t *plan)
+{
+    free(plan->names);
+    free(plan->stm32_crc);
+    free(plan->stm32_known);
+    plan->names = NULL;
+    plan->stm32_crc = NULL;
+    plan->stm32_known = NULL;
+    plan->count = 0;
+}
+
+/**
+ * @brief Take the background of every view from the option model.
+ *
+ * @return true if @p plan was filled, release it with mirror_plan_free().
+ */
+static bool mirror_plan_load(mirror_plan_t *plan)
+{
+    int count = view_options_background_count();
+    if (count == 0) {
+        ESP_LOGI(TAG, "No views in the option list");
+        return false;
+    }
+
+    plan->count = count;
+    plan->names = calloc(count, MIRROR_NAME_SIZE);
+    plan->stm32_crc = calloc(count, sizeof(uint32_t));
+    plan->stm32_known = calloc(count, sizeof(bool));
+    if (!plan->names || !plan->stm32_crc || !plan->stm32_known) {
+        ESP_LOGE(TAG, "No memory for sync plan");
+        mirror_plan_free(plan);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        view_background_t background;
+        if (view_options_background(i, &background)) {
+            memcpy(plan->names[i], background.path, MIRROR_NAME_SIZE);
         }
-    } else {
-        ESP_LOGI(TAG, "view_background[%d] is not a valid string", background_idx);
     }
 
-    // Clean up
-    cJSON_Delete(root);
-    return num_bytes;
+    return true;
 }
 
-void mirror_spiffs(void)
+/* Fetch the STM32 CRC of every view with a background in one batch */
+static void mirror_plan_query(mirror_plan_t *plan)
 {
-    char *ptr;
-    uint32_t len;
-    get_option_list_info(&ptr, &len);
+    bool *want = calloc(plan->count ? plan->count : 1, sizeof(bool));
+    if (!want) {
+        return;
+    }
+
+    int wanted = 0;
+    for (int i = 0; i < plan->count; i++) {
+        want[i] = plan->names[i][0] != '\0';
+        wanted += want[i];
+    }
+
+    int64_t start = esp_timer_get_time();
+    int answered = ke_txn_background_crcs(plan->count, want, plan->stm32_crc, plan->stm32_known,
+                                          MIRROR_CRC_BATCH_MS);
+    ESP_LOGI(TAG, "STM32 answered %d of %d CRC queries in %lld ms", answered, wanted,
+             (esp_timer_get_time() - start) / 1000);
+    free(want);
+}
+
+/**
+ * @brief Count the views whose background differs from the one on the STM32.
+ *
+ * Only the manifest is consulted. A PNG missing from it counts as changed,
+ * decoding it here would hold up the caller for as long as a sync.
+ */
+static int mirror_plan_changed(const mirror_plan_t *plan)
+{
+    int changed = 0;
+    for (int i = 0; i < plan->count; i++) {
+        const char *image_name = plan->names[i];
+        if (image_name[0] == '\0') {
+            continue;
+        }
+
+        uint32_t img_crc;
+        if (!bg_manifest_lookup(image_name, &img_crc, NULL, NULL)) {
+            // Missing files are skipped by the sync, undecoded ones may still differ
+            changed += access(image_name, F_OK) == 0;
+            continue;
+        }
+        if (!plan->stm32_known[i] || plan->stm32_crc[i] != img_crc) {
+            changed++;
+        }
+    }
+    return changed;
+}
 
-    // Parse the JSON string
-    cJSON *root = cJSON_Parse(ptr);
-    if (root == NULL) {
-        ESP_LOGI(TAG, "Error parsing JSON!\n");
+static void mirror_spiffs_views(void)
+{
+    if (!stm32_link_available()) {
+        ESP_LOGW(TAG, "STM32 is not answering, background sync skipped");
         return;
     }
-    
-    // Get the "view_background" array from the JSON object
-    cJSON *view_background = cJSON_GetObjectItemCaseSensitive(root, "view_background");
-    if (!cJSON_IsArray(view_background)) {
-        ESP_LOGI(TAG, "\"view_background\" is not an array or does not exist!");
-        cJSON_Delete(root);
+
+    if (!mirror_plan_load(&mirror_plan)) {
         return;
     }
-    
-    int count = cJSON_GetArraySize(view_background);
+    int count = mirror_plan.count;
+
+    int64_t sync_start = esp_timer_get_time();
+    mirror_plan_query(&mirror_plan);
+    ESP_LOGI(TAG, "Up to %d of %d views need sending", mirror_plan_changed(&mirror_plan), count);
+
+    // The next view is compared, and CRC-decoded if it is new, on the other core while the current one is on the wire
+    bool pipelined = xTaskCreatePinnedToCore(mirror_prepare_task, "mirror_prepare", 8192,
+                                             &mirror_plan, 5, NULL, MIRROR_PREPARE_CORE) == pdPASS;
+    if (!pipelined) {
+        ESP_LOGW(TAG, "No prepare worker, syncing backgrounds one at a time");
+    }
+
+    int sent = 0;
     for (int i = 0; i < count; i++) {
-        cJSON *user = cJSON_GetArrayItem(view_background, i);
-        if (cJSON_IsString(user) && user->valuestring != NULL) {
-            char image_name[64] = {0};
-            snprintf(image_name, sizeof(image_name), "/spiffs/%s.png", user->valuestring);
-            
-            FILE *fp = fopen(image_name, "rb");
-            if (fp) {
-                ESP_LOGI(TAG, "File exists: %s", image_name);
-                uint32_t img_crc = crc32_png_rgba(fp);
-                ESP_LOGI(TAG, "ESP32 CRC: %lu", img_crc);
-                Generate_TX_Message(&stm32_comm, KE_BACKGROUND_CRC_REQUEST, &i );
-                KE_wait_for_response(&stm32_comm, 1000);
-                ESP_LOGI(TAG, "STM32 CRC: %lu", background_crc);
-                if( background_crc == img_crc ) {
-                    ESP_LOGI(TAG, "Image match, skipping");
-                } else {
-                    Generate_TX_Message(&stm32_comm, KE_BACKGROUND_SEND, &i );
-                    KE_wait_for_response(&stm32_comm, 30000);
-                }
-                fclose(fp);
-            } else {
-                ESP_LOGI(TAG, "File not found: %s", image_name);
-            }
+        bool send;
+        if (pipelined) {
+            xQueueReceive(prepare_results, &send, portMAX_DELAY);
         } else {
-            ESP_LOGI(TAG, "view_background[%d] is not a valid string", i);
+            send = prepare_background(i, &mirror_plan);
+        }
+
+        if (send && !stm32_link_available()) {
+            // The worker still hands over every view, only the sends stop
+            ESP_LOGW(TAG, "STM32 stopped answering, view %d not sent", i);
+            send = false;
+        }
+
+        if (send) {
+            // Each view is its own bulk request, queued config traffic goes in between
+            int64_t send_start = esp_timer_get_time();
+            ke_sched_request(&stm32_comm, KE_SCHED_BULK, KE_BACKGROUND_SEND, &i, 30000);
+            ESP_LOGI(TAG, "View %d sent in %lld ms", i, (esp_timer_get_time() - send_start) / 1000);
+            sent++;
+        }
+    }
+
+    ESP_LOGI(TAG, "Sync of %d views (%d sent) took %lld ms", count, sent,
+             (esp_timer_get_time() - sync_start) / 1000);
+
+    // The worker hands over its last view before it exits, nothing touches the plan after this
+    mirror_plan_free(&mirror_plan);
+}
+
+#if DEBUG_SYNC_HEAP_STATS
+/* Free and minimum free internal RAM, and how fragmented what is left has become */
+static void log_sync_heap_stats(void)
+{
+    size_t free_size = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    unsigned frag = free_size ? 100 - (unsigned)(largest * 100 / free_size) : 0;
+
+    png_arena_stats_t arena;
+    png_arena_get_stats(&arena);
+
+    ESP_LOGI(TAG, "Internal heap: %u free, %u min free, %u largest block, %u%% fragmented",
+             (unsigned)free_size, (unsigned)min_free, (unsigned)largest, frag);
+    ESP_LOGI(TAG, "Decode arenas: %lu sessions, %lu pool misses, %lu overflows, %lu bytes peak",
+             (unsigned long)arena.sessions, (unsigned long)arena.pool_misses,
+             (unsigned long)arena.overflow_allocs, (unsigned long)arena.peak_used);
+}
+#endif
+
+/**
+ * @brief Bring the STM32 backgrounds in line with the PNGs in SPIFFS.
+ *
+ * Boot, the resync task and the mirror request task call this, runs are
+ * serialised. The HTTP endpoints go through mirror_spiffs_request().
+ */
+void mirror_spiffs(void)
+{
+    xSemaphoreTake(mirror_lock, portMAX_DELAY);
+
+    mirror_spiffs_views();
+
+#if DEBUG_SYNC_HEAP_STATS
+    log_sync_heap_stats();
+#endif
+
+    xSemaphoreGive(mirror_lock);
+}
+
+/* Runs the syncs queued by mirror_spiffs_request(), requests made during a run fold into one more run */
+static void mirror_request_task(void *pvParameters)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        mirror_spiffs();
+    }
+}
+
+/**
+ * @brief Queue a background sync and return without waiting for it.
+ *
+ * A sync sends up to 800 KB per view and takes many seconds, so the HTTP
+ * endpoints hand it to the mirror request task and answer straight away.
+ *
+ * @return false if the mirror request task is not running.
+ */
+bool mirror_spiffs_request(void)
+{
+    if (!mirror_request_task_handle) {
+        return false;
+    }
+
+    xTaskNotifyGive(mirror_request_task_handle);
+    return true;
+}
+
+/**
+ * @brief Count the backgrounds that differ from the STM32 without sending any.
+ *
+ * @param views     Set to the number of views with a background.
+ * @param pending   Set to the number of those a sync would send, views not
+ *                  in the manifest yet are counted without decoding them.
+ *
+ * @return false if a sync is running or the option list cannot be read.
+ */
+bool mirror_sync_status(int *views, int *pending)
+{
+    if (xSemaphoreTake(mirror_lock, 0) != pdTRUE) {
+        return false;
+    }
+
+    mirror_plan_t plan = {0};
+    bool ok = mirror_plan_load(&plan);
+    if (ok) {
+        mirror_plan_query(&plan);
+        *views = 0;
+        for (int i = 0; i < plan.count; i++) {
+            *views += plan.names[i][0] != '\0';
         }
+        *pending = mirror_plan_changed(&plan);
+        mirror_plan_free(&plan);
     }
-    
-    // Clean up
-    cJSON_Delete(root);
+
+    xSemaphoreGive(mirror_lock);
+    return ok;
 }
 
 void stm32_communication_init(void)
@@ -349,30 +637,62 @@ void stm32_communication_init(void)
     stm32_comm.init.firmware_version_minor  = 0;  /* Minor firmware version */
     stm32_comm.init.firmware_version_hotfix = 0;  /* Hot fix firmware version */
     stm32_comm.init.png_to_rgba = &png_to_rgba;
-    stm32_comm.tx_buffer_size = (UI_HOR_RES*UI_VER_RES*4)+128;
-    stm32_comm.rx_buffer_size = 6000;
+    // The largest request is a background in the wire format, or a full config
+    uint32_t max_config_len;
+    get_json_data_output_info(NULL, &max_config_len);
+    stm32_comm.tx_buffer_size = MAX(UI_HOR_RES * UI_VER_RES * bg_format_bpp(BG_WIRE_FORMAT), max_config_len) + 128;
+    // The largest response is a full config, it has to fit in one frame
+    get_json_data_input_info(NULL, &max_config_len);
+    stm32_comm.rx_buffer_size = max_config_len + 128;
     stm32_comm.tx_buffer = (uint8_t *)heap_caps_malloc(stm32_comm.tx_buffer_size, MALLOC_CAP_SPIRAM);
     stm32_comm.rx_buffer = (uint8_t *)heap_caps_malloc(stm32_comm.rx_buffer_size, MALLOC_CAP_SPIRAM);
+#if CONFIG_ESP32_STM32_UART_LZ4
+    tx_packed_size = stm32_lz4_bound(stm32_comm.tx_buffer_size);
+    tx_packed = (uint8_t *)heap_caps_malloc(tx_packed_size, MALLOC_CAP_SPIRAM);
+    if (!tx_packed) {
+        ESP_LOGE(TAG, "No memory for the compressed TX frame");
+    }
+#endif
+    mirror_lock = xSemaphoreCreateMutex();
+    // Same stack as the httpd task the sync used to run on
+    if (xTaskCreate(mirror_request_task, "mirror_request", 8192, NULL, 3, &mirror_request_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "No mirror request task, HTTP sync requests will be refused");
+        mirror_request_task_handle = NULL;
+    }
+    prepare_results = xQueueCreate(1, sizeof(bool));
+    ke_sched_init();
+    ke_txn_init(&stm32_comm);
+    view_options_init();
     uart_init(&stm32_comm);
 }
 
-void KE_tick_wrapper(void* arg) {
-    KE_tick();
+/* Send the boot requests up front so their round trips overlap */
+static void fetch_stm32_lists(void)
+{
+    uint32_t config_txn = ke_txn_begin(KE_TXN_CONFIG, 0);
+    uint32_t option_txn = ke_txn_begin(KE_TXN_OPTION_LIST, 0);
+    uint32_t pid_txn = ke_txn_begin(KE_TXN_PID_LIST, 0);
+    ke_txn_wait(config_txn, 1000, NULL);
+    ke_txn_wait(option_txn, 1000, NULL);
+    ke_txn_wait(pid_txn, 1000, NULL);
 }
 
-void start_KE_tick_timer(void) {
-    const esp_timer_create_args_t timer_args = {
-        .callback = &KE_tick_wrapper,
-        .name = "ke_tick_timer"
-    };
+/* Repeat the boot sync whenever the STM32 comes back after being down */
+static void link_resync_task(void *pvParameters)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-    esp_timer_handle_t periodic_timer;
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &periodic_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(periodic_timer, 1000)); // 1000us = 1ms
+        ESP_LOGI(TAG, "STM32 is back, repeating the boot sync");
+        fetch_stm32_lists();
+        stm32_link_negotiate_baud();
+        mirror_spiffs();
+    }
 }
 
 void app_main(void)
 {
+    checksum_init();
     gpio_init();
     stm32_communication_init();
 
@@ -394,7 +714,15 @@ void app_main(void)
         }
     }
 
-    start_KE_tick_timer();
+    // KE_Service and the KE clock now run from their own task
+    stm32_link_start(&stm32_comm);
+
+    TaskHandle_t resync_task = NULL;
+    if (xTaskCreate(link_resync_task, "link_resync", 4096, NULL, 3, &resync_task) == pdPASS) {
+        stm32_link_set_up_notify(resync_task);
+    } else {
+        ESP_LOGW(TAG, "No resync task, an STM32 missing at boot stays unsynced");
+    }
 
     // Flash the STM32 bootloader
     // flash_stm32_bootloader("STM32U5G9ZJTXQ_OSPI_Bootloader.bin");
@@ -403,18 +731,17 @@ void app_main(void)
     // End flash the STM32 bootloader
 
 
-    Generate_TX_Message(&stm32_comm, KE_CONFIG_REQUEST, 0);
-    KE_wait_for_response(&stm32_comm, 1000);
-    Generate_TX_Message(&stm32_comm, KE_OPTION_LIST_REQUEST, 0);
-    KE_wait_for_response(&stm32_comm, 1000);
-    Generate_TX_Message(&stm32_comm, KE_PID_LIST_REQUEST, 0);
-    KE_wait_for_response(&stm32_comm, 1000);
-    mirror_spiffs();
+    fetch_stm32_lists();
 
-    while (1)
-    {
-        // Add delay to not trigger watchdog
-        vTaskDelay(pdMS_TO_TICKS(1));
-        KE_Service(&stm32_comm);
+    // Without an STM32 the probes and the sync would only wait out their timeouts,
+    // the resync task runs them once the heartbeat hears from it
+    if (!stm32_link_available()) {
+        ESP_LOGW(TAG, "STM32 is not answering, deferring baud negotiation and background sync");
+        return;
     }
+
+    // Try to move the link to a faster baud rate now that the STM32 is talking
+    stm32_link_negotiate_baud();
+
+    mirror_spiffs();
 }
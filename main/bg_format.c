@@ -0,0 +1,57 @@
+#include "bg_format.h"
+#include <string.h>
+
+// 4x4 Bayer matrix, thresholds 0..15
+static const uint8_t bayer4[4][4] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5},
+};
+
+/* RGB565 with an ordered dither, smooth gradients band far less than truncating */
+static void pack_rgb565(const uint8_t *in, uint8_t *out, uint32_t width, uint32_t y)
+{
+    const uint8_t *t = bayer4[y & 3];
+
+    for (uint32_t x = 0; x < width; x++, in += 4) {
+        uint32_t d = t[x & 3];
+
+        // Up to one step of 5 bits is 8 levels, of 6 bits 4 levels
+        uint32_t r = (in[2] + (d >> 1)) >> 3;
+        uint32_t g = (in[1] + (d >> 2)) >> 2;
+        uint32_t b = (in[0] + (d >> 1)) >> 3;
+        if (r > 31) r = 31;
+        if (g > 63) g = 63;
+        if (b > 31) b = 31;
+
+        uint16_t px = (uint16_t)((r << 11) | (g << 5) | b);
+        out[2 * x] = px & 0xFF;
+        out[2 * x + 1] = px >> 8;
+    }
+}
+
+/**
+ * @brief Convert one decoded BGRA row to a background wire format.
+ *
+ * @p out may be @p bgra, every pixel is read before its bytes are overwritten.
+ *
+ * @param format    Target format.
+ * @param bgra      BGRA pixels, any alignment.
+ * @param out       width * bg_format_bpp(format) bytes.
+ * @param width     Pixels in the row.
+ * @param y         Row number, selects the dither pattern.
+ */
+void bg_format_pack_row(bg_format_t format, const uint8_t *bgra, uint8_t *out, uint32_t width, uint32_t y)
+{
+    switch (format) {
+    case BG_FORMAT_RGB565:
+        pack_rgb565(bgra, out, width, y);
+        break;
+    default:
+        if (out != bgra) {
+            memmove(out, bgra, width * 4);
+        }
+        break;
+    }
+}
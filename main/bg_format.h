@@ -0,0 +1,26 @@
+#ifndef BG_FORMAT_H
+#define BG_FORMAT_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Pixel layout of a background frame on the wire and in every frame buffer
+typedef enum {
+    BG_FORMAT_BGRA8888 = 0,     // 4 bytes, B G R A
+    BG_FORMAT_RGB565 = 1,       // 2 bytes, little endian, ordered dither, alpha dropped
+} bg_format_t;
+
+#if CONFIG_BG_WIRE_FORMAT_RGB565
+#define BG_WIRE_FORMAT BG_FORMAT_RGB565
+#else
+#define BG_WIRE_FORMAT BG_FORMAT_BGRA8888
+#endif
+
+static inline uint32_t bg_format_bpp(bg_format_t format)
+{
+    return (format == BG_FORMAT_RGB565) ? 2 : 4;
+}
+
+void bg_format_pack_row(bg_format_t format, const uint8_t *bgra, uint8_t *out, uint32_t width, uint32_t y);
+
+#endif
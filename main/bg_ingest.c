@@ -0,0 +1,276 @@
+#include "bg_ingest.h"
+#include "bg_manifest.h"
+#include "png_transfer.h"
+#include "bg_format.h"
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "Ingest";
+
+#define BG_RAW_MAGIC     0x41524742 // "BGRA"
+#define BG_RAW_EXT       ".bgra"
+#define BG_PATH_SIZE     128
+
+/*
+ * Sidecar written next to each uploaded background: this header followed by
+ * the decoded frame exactly as KE_BACKGROUND_SEND carries it. The header
+ * ties the frame to the PNG it came from, a sidecar whose PNG has since been
+ * replaced is ignored.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t crc;
+    uint32_t png_size;
+    uint32_t format;        // bg_format_t of the frame
+    int64_t png_mtime;
+} bg_raw_header_t;
+
+struct bg_ingest {
+    png_stream_t *stream;
+    FILE *raw;
+    bool bad_size;
+    char png_path[BG_PATH_SIZE];
+    char raw_path[BG_PATH_SIZE];
+};
+
+/* Sidecar path for a background, "/spiffs/User1.png" -> "/spiffs/User1.bgra" */
+static bool bg_raw_path(const char *png_path, char *raw_path, size_t size)
+{
+    size_t len = strlen(png_path);
+    if (len > 4 && strcasecmp(&png_path[len - 4], ".png") == 0) {
+        len -= 4;
+    }
+
+    int written = snprintf(raw_path, size, "%.*s%s", (int)len, png_path, BG_RAW_EXT);
+    return written > 0 && (size_t)written < size;
+}
+
+/* Stop writing the sidecar, the upload itself is still validated */
+static void bg_ingest_drop_raw(bg_ingest_t *ingest)
+{
+    if (ingest->raw) {
+        fclose(ingest->raw);
+        ingest->raw = NULL;
+        unlink(ingest->raw_path);
+    }
+}
+
+static bool bg_ingest_on_info(uint32_t width, uint32_t height, void *arg)
+{
+    bg_ingest_t *ingest = arg;
+
+    if (width != BG_INGEST_WIDTH || height != BG_INGEST_HEIGHT) {
+        ESP_LOGW(TAG, "%s is %lux%lu, backgrounds must be %dx%d", ingest->png_path,
+                 (unsigned long)width, (unsigned long)height, BG_INGEST_WIDTH, BG_INGEST_HEIGHT);
+        ingest->bad_size = true;
+        return false;
+    }
+
+    return true;
+}
+
+static bool bg_ingest_on_row(const uint8_t *row, uint32_t y, uint32_t len, void *arg)
+{
+    bg_ingest_t *ingest = arg;
+
+    if (ingest->raw && fwrite(row, 1, len, ingest->raw) != len) {
+        ESP_LOGW(TAG, "Failed to write %s, continuing without it", ingest->raw_path);
+        bg_ingest_drop_raw(ingest);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Start ingesting a background PNG while it is being uploaded.
+ *
+ * Each piece of the upload is inflated as it arrives, the size is checked
+ * against the display, the frame CRC is accumulated and, with
+ * CONFIG_BG_RAW_SIDECAR, the decoded frame is written to a sidecar file so a
+ * later sync sends it without touching the PNG.
+ *
+ * @param png_path  Full SPIFFS path the PNG is being written to.
+ *
+ * @return Ingest handle, NULL if out of memory.
+ */
+bg_ingest_t *bg_ingest_begin(const char *png_path)
+{
+    bg_ingest_t *ingest = calloc(1, sizeof(bg_ingest_t));
+    if (!ingest) {
+        return NULL;
+    }
+
+    snprintf(ingest->png_path, sizeof(ingest->png_path), "%s", png_path);
+
+#if CONFIG_BG_RAW_SIDECAR
+    if (bg_raw_path(png_path, ingest->raw_path, sizeof(ingest->raw_path))) {
+        ingest->raw = fopen(ingest->raw_path, "wb");
+    }
+
+    // Zeroed header until the frame is complete, a torn sidecar never validates
+    bg_raw_header_t header = {0};
+    if (ingest->raw && fwrite(&header, 1, sizeof(header), ingest->raw) != sizeof(header)) {
+        bg_ingest_drop_raw(ingest);
+    }
+    if (!ingest->raw) {
+        ESP_LOGW(TAG, "No sidecar for %s, it will be decoded on sync", png_path);
+    }
+#endif
+
+    ingest->stream = png_stream_begin(bg_ingest_on_info, bg_ingest_on_row, ingest);
+    if (!ingest->stream) {
+        bg_ingest_drop_raw(ingest);
+        free(ingest);
+        return NULL;
+    }
+
+    return ingest;
+}
+
+/**
+ * @brief Feed the next piece of the upload.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the image is not 1024x200, ESP_FAIL if
+ *         the data is not a PNG that can be decoded.
+ */
+esp_err_t bg_ingest_feed(bg_ingest_t *ingest, const uint8_t *data, size_t len)
+{
+    if (!ingest) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!png_stream_feed(ingest->stream, data, len)) {
+        return ingest->bad_size ? ESP_ERR_INVALID_SIZE : ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Complete the ingest once the PNG file has been closed.
+ *
+ * Seals the sidecar with the PNG's size and mtime and records the CRC in the
+ * background manifest. Frees @p ingest.
+ *
+ * @return ESP_OK, or ESP_FAIL if the upload did not contain a complete PNG.
+ */
+esp_err_t bg_ingest_finish(bg_ingest_t *ingest)
+{
+    if (!ingest) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t crc = 0, width = 0, height = 0;
+    bool complete = png_stream_finish(ingest->stream, &crc, &width, &height);
+    ingest->stream = NULL;
+
+    struct stat st;
+    if (!complete || stat(ingest->png_path, &st) != 0) {
+        ESP_LOGW(TAG, "%s is not a complete PNG", ingest->png_path);
+        bg_ingest_abort(ingest);
+        return ESP_FAIL;
+    }
+
+    if (ingest->raw) {
+        bg_raw_header_t header = {
+            .magic = BG_RAW_MAGIC,
+            .width = width,
+            .height = height,
+            .crc = crc,
+            .png_size = st.st_size,
+            .format = BG_WIRE_FORMAT,
+            .png_mtime = st.st_mtime,
+        };
+
+        bool sealed = fseek(ingest->raw, 0, SEEK_SET) == 0 &&
+                      fwrite(&header, 1, sizeof(header), ingest->raw) == sizeof(header);
+        if (fclose(ingest->raw) != 0) {
+            sealed = false;
+        }
+        ingest->raw = NULL;
+        if (!sealed) {
+            unlink(ingest->raw_path);
+        }
+    }
+
+    bg_manifest_store(ingest->png_path, crc, width, height);
+    ESP_LOGI(TAG, "%s ingested, CRC: %lu", ingest->png_path, (unsigned long)crc);
+
+    free(ingest);
+    return ESP_OK;
+}
+
+/**
+ * @brief Drop an ingest after a failed upload, removing any partial sidecar.
+ */
+void bg_ingest_abort(bg_ingest_t *ingest)
+{
+    if (!ingest) {
+        return;
+    }
+
+    png_stream_finish(ingest->stream, NULL, NULL, NULL);
+    bg_ingest_drop_raw(ingest);
+    free(ingest);
+}
+
+/**
+ * @brief Open the ingested frame of a background.
+ *
+ * @param png_path  Full SPIFFS path of the PNG.
+ * @param max_len   Largest frame the caller can take.
+ * @param len       Set to the frame length in bytes.
+ *
+ * @return File positioned at the first pixel, or NULL if there is no sidecar
+ *         matching the PNG's current size and mtime and BG_WIRE_FORMAT.
+ *         Close with fclose().
+ */
+FILE *bg_ingest_open_raw(const char *png_path, uint32_t max_len, uint32_t *len)
+{
+    char raw_path[BG_PATH_SIZE];
+    struct stat png_st, raw_st;
+    if (!bg_raw_path(png_path, raw_path, sizeof(raw_path)) ||
+        stat(png_path, &png_st) != 0 || stat(raw_path, &raw_st) != 0) {
+        return NULL;
+    }
+
+    FILE *fp = fopen(raw_path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    bg_raw_header_t header = {0};
+    uint32_t frame_len = 0;
+    if (fread(&header, 1, sizeof(header), fp) == sizeof(header)) {
+        frame_len = header.width * header.height * bg_format_bpp(header.format);
+    }
+
+    if (header.magic != BG_RAW_MAGIC || header.format != BG_WIRE_FORMAT || frame_len == 0 || frame_len > max_len ||
+        raw_st.st_size != (off_t)(sizeof(header) + frame_len) ||
+        header.png_size != (uint32_t)png_st.st_size || header.png_mtime != (int64_t)png_st.st_mtime) {
+        fclose(fp);
+        return NULL;
+    }
+
+    *len = frame_len;
+    return fp;
+}
+
+/**
+ * @brief Delete the sidecar of a background that was removed or replaced.
+ */
+void bg_ingest_remove(const char *png_path)
+{
+    char raw_path[BG_PATH_SIZE];
+    if (bg_raw_path(png_path, raw_path, sizeof(raw_path))) {
+        unlink(raw_path);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef BG_INGEST_H
+#define BG_INGEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+#define BG_INGEST_WIDTH  1024
+#define BG_INGEST_HEIGHT 200
+
+typedef struct bg_ingest bg_ingest_t;
+
+bg_ingest_t *bg_ingest_begin(const char *png_path);
+esp_err_t bg_ingest_feed(bg_ingest_t *ingest, const uint8_t *data, size_t len);
+esp_err_t bg_ingest_finish(bg_ingest_t *ingest);
+void bg_ingest_abort(bg_ingest_t *ingest);
+
+FILE *bg_ingest_open_raw(const char *png_path, uint32_t max_len, uint32_t *len);
+void bg_ingest_remove(const char *png_path);
+
+#endif
@@ -0,0 +1,306 @@
+#include "bg_manifest.h"
+#include "png_transfer.h"
+#include "bg_format.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "Manifest";
+
+#define BG_MANIFEST_PATH        "/spiffs/bg_manifest.json"
+#define BG_MANIFEST_MAX_ENTRIES 32
+#define BG_MANIFEST_NAME_SIZE   64
+
+/*
+ * CRC of each background PNG as decoded to BG_WIRE_FORMAT, keyed by file
+ * name and only trusted while the file size and mtime still match. Lets a sync compare
+ * against the STM32 without inflating every PNG again.
+ */
+typedef struct {
+    char name[BG_MANIFEST_NAME_SIZE];
+    uint32_t size;
+    int64_t mtime;
+    uint32_t crc;
+    uint32_t width;
+    uint32_t height;
+} bg_manifest_entry_t;
+
+static bg_manifest_entry_t manifest[BG_MANIFEST_MAX_ENTRIES];
+static int manifest_count = 0;
+static SemaphoreHandle_t manifest_lock = NULL;
+
+/* Manifest key for a path, the file name without the directory */
+static const char *bg_manifest_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static bg_manifest_entry_t *bg_manifest_find(const char *name)
+{
+    for (int i = 0; i < manifest_count; i++) {
+        if (strcmp(manifest[i].name, name) == 0) {
+            return &manifest[i];
+        }
+    }
+    return NULL;
+}
+
+static void bg_manifest_drop(const char *name)
+{
+    bg_manifest_entry_t *entry = bg_manifest_find(name);
+    if (entry) {
+        *entry = manifest[--manifest_count];
+    }
+}
+
+/* Write the manifest back to SPIFFS, caller must hold manifest_lock */
+static void bg_manifest_save(void)
+{
+    cJSON *root = cJSON_CreateArray();
+    if (!root) {
+        return;
+    }
+
+    for (int i = 0; i < manifest_count; i++) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", manifest[i].name);
+        cJSON_AddNumberToObject(item, "size", manifest[i].size);
+        cJSON_AddNumberToObject(item, "mtime", (double)manifest[i].mtime);
+        cJSON_AddNumberToObject(item, "crc", manifest[i].crc);
+        cJSON_AddNumberToObject(item, "width", manifest[i].width);
+        cJSON_AddNumberToObject(item, "height", manifest[i].height);
+        cJSON_AddNumberToObject(item, "format", BG_WIRE_FORMAT);
+        cJSON_AddItemToArray(root, item);
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json) {
+        return;
+    }
+
+    // A torn write only costs a re-decode, a bad manifest is discarded on load
+    FILE *fp = fopen(BG_MANIFEST_PATH, "w");
+    if (fp) {
+        fputs(json, fp);
+        fclose(fp);
+    } else {
+        ESP_LOGW(TAG, "Failed to write %s", BG_MANIFEST_PATH);
+    }
+    free(json);
+}
+
+static double bg_manifest_number(const cJSON *item, const char *key)
+{
+    const cJSON *value = cJSON_GetObjectItemCaseSensitive(item, key);
+    return cJSON_IsNumber(value) ? value->valuedouble : 0;
+}
+
+static void bg_manifest_load(void)
+{
+    manifest_count = 0;
+
+    FILE *fp = fopen(BG_MANIFEST_PATH, "r");
+    if (!fp) {
+        ESP_LOGI(TAG, "No manifest yet");
+        return;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char *json = (len > 0) ? malloc(len + 1) : NULL;
+    if (!json) {
+        fclose(fp);
+        return;
+    }
+    json[fread(json, 1, len, fp)] = '\0';
+    fclose(fp);
+
+    cJSON *root = cJSON_Parse(json);
+    free(json);
+    if (!cJSON_IsArray(root)) {
+        ESP_LOGW(TAG, "Discarding unreadable manifest");
+        cJSON_Delete(root);
+        return;
+    }
+
+    cJSON *item;
+    cJSON_ArrayForEach(item, root) {
+        if (manifest_count >= BG_MANIFEST_MAX_ENTRIES) {
+            break;
+        }
+
+        cJSON *name = cJSON_GetObjectItemCaseSensitive(item, "name");
+        if (!cJSON_IsString(name) || strlen(name->valuestring) >= BG_MANIFEST_NAME_SIZE) {
+            continue;
+        }
+        // CRCs of another pixel format describe different bytes, they are decoded again
+        if ((int)bg_manifest_number(item, "format") != BG_WIRE_FORMAT) {
+            continue;
+        }
+
+        bg_manifest_entry_t *entry = &manifest[manifest_count++];
+        strcpy(entry->name, name->valuestring);
+        entry->size = (uint32_t)bg_manifest_number(item, "size");
+        entry->mtime = (int64_t)bg_manifest_number(item, "mtime");
+        entry->crc = (uint32_t)bg_manifest_number(item, "crc");
+        entry->width = (uint32_t)bg_manifest_number(item, "width");
+        entry->height = (uint32_t)bg_manifest_number(item, "height");
+    }
+
+    cJSON_Delete(root);
+    ESP_LOGI(TAG, "Loaded %d background CRCs", manifest_count);
+}
+
+/**
+ * @brief Load the background manifest from SPIFFS. Call after SPIFFS is mounted.
+ */
+void bg_manifest_init(void)
+{
+    if (!manifest_lock) {
+        manifest_lock = xSemaphoreCreateMutex();
+    }
+
+    xSemaphoreTake(manifest_lock, portMAX_DELAY);
+    bg_manifest_load();
+    xSemaphoreGive(manifest_lock);
+}
+
+/**
+ * @brief Look up a background PNG without decoding it.
+ *
+ * @param path      Full SPIFFS path of the PNG.
+ * @param crc       Set to the CRC-32 of the decoded BGRA pixels.
+ * @param width     Set to the image width, may be NULL.
+ * @param height    Set to the image height, may be NULL.
+ *
+ * @return true if the manifest has an entry matching the file's size and mtime.
+ */
+bool bg_manifest_lookup(const char *path, uint32_t *crc, uint32_t *width, uint32_t *height)
+{
+    struct stat st;
+    if (!manifest_lock || stat(path, &st) != 0) {
+        return false;
+    }
+
+    bool hit = false;
+    xSemaphoreTake(manifest_lock, portMAX_DELAY);
+    bg_manifest_entry_t *entry = bg_manifest_find(bg_manifest_name(path));
+    if (entry && entry->size == (uint32_t)st.st_size && entry->mtime == (int64_t)st.st_mtime) {
+        *crc = entry->crc;
+        if (width) *width = entry->width;
+        if (height) *height = entry->height;
+        hit = true;
+    }
+    xSemaphoreGive(manifest_lock);
+
+    return hit;
+}
+
+/**
+ * @brief Record the decoded CRC and size of a background PNG.
+ *
+ * The entry is tied to the file's current size and mtime.
+ */
+void bg_manifest_store(const char *path, uint32_t crc, uint32_t width, uint32_t height)
+{
+    struct stat st;
+    const char *name = bg_manifest_name(path);
+    if (!manifest_lock || stat(path, &st) != 0 || strlen(name) >= BG_MANIFEST_NAME_SIZE) {
+        return;
+    }
+
+    xSemaphoreTake(manifest_lock, portMAX_DELAY);
+    bg_manifest_entry_t *entry = bg_manifest_find(name);
+    if (!entry && manifest_count < BG_MANIFEST_MAX_ENTRIES) {
+        entry = &manifest[manifest_count++];
+        strcpy(entry->name, name);
+    }
+    if (entry) {
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtime;
+        entry->crc = crc;
+        entry->width = width;
+        entry->height = height;
+        bg_manifest_save();
+    }
+    xSemaphoreGive(manifest_lock);
+}
+
+/**
+ * @brief Get the decoded BGRA CRC and size of a background PNG.
+ *
+ * Served from the manifest while the file's size and mtime are unchanged,
+ * otherwise the PNG is decoded once and the manifest updated.
+ *
+ * @param path      Full SPIFFS path of the PNG.
+ * @param crc       Set to the CRC-32 of the decoded BGRA pixels.
+ * @param width     Set to the image width, may be NULL.
+ * @param height    Set to the image height, may be NULL.
+ *
+ * @return true on success, false if the file is missing or cannot be decoded.
+ */
+bool bg_manifest_get_crc(const char *path, uint32_t *crc, uint32_t *width, uint32_t *height)
+{
+    if (bg_manifest_lookup(path, crc, width, height)) {
+        return true;
+    }
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+    uint32_t w = 0, h = 0;
+    uint32_t img_crc = crc32_png_rgba(fp, &w, &h);
+    fclose(fp);
+    if (w == 0 || h == 0) {
+        ESP_LOGW(TAG, "Failed to decode %s", path);
+        return false;
+    }
+
+    bg_manifest_store(path, img_crc, w, h);
+
+    *crc = img_crc;
+    if (width) *width = w;
+    if (height) *height = h;
+    return true;
+}
+
+/**
+ * @brief Recompute the manifest entry for a PNG that was just written.
+ */
+void bg_manifest_update(const char *path)
+{
+    bg_manifest_remove(path);
+
+    uint32_t crc;
+    if (bg_manifest_get_crc(path, &crc, NULL, NULL)) {
+        ESP_LOGI(TAG, "%s CRC: %lu", path, (unsigned long)crc);
+    }
+}
+
+/**
+ * @brief Forget a PNG that was deleted or replaced.
+ */
+void bg_manifest_remove(const char *path)
+{
+    if (!manifest_lock) {
+        return;
+    }
+
+    xSemaphoreTake(manifest_lock, portMAX_DELAY);
+    const char *name = bg_manifest_name(path);
+    if (bg_manifest_find(name)) {
+        bg_manifest_drop(name);
+        bg_manifest_save();
+    }
+    xSemaphoreGive(manifest_lock);
+}
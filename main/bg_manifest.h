@@ -0,0 +1,14 @@
+#ifndef BG_MANIFEST_H
+#define BG_MANIFEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void bg_manifest_init(void);
+bool bg_manifest_lookup(const char *path, uint32_t *crc, uint32_t *width, uint32_t *height);
+void bg_manifest_store(const char *path, uint32_t crc, uint32_t width, uint32_t height);
+bool bg_manifest_get_crc(const char *path, uint32_t *crc, uint32_t *width, uint32_t *height);
+void bg_manifest_update(const char *path);
+void bg_manifest_remove(const char *path);
+
+#endif
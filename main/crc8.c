@@ -1,16 +0,0 @@
-#include "crc8.h"
-
-// CRC-8 calculation function (poly 0x07, initial 0x00)
-uint8_t crc8(const uint8_t *data, size_t len) {
-    uint8_t crc = 0x00;
-    for (size_t i = 0; i < len; i++) {
-        crc ^= data[i];
-        for (uint8_t bit = 0; bit < 8; bit++) {
-            if (crc & 0x80)
-                crc = (crc << 1) ^ 0x07;
-            else
-                crc <<= 1;
-        }
-    }
-    return crc;
-}
\ No newline at end of file
@@ -1,9 +0,0 @@
-#ifndef CRC8_H
-#define CRC8_H
-
-#include <stdint.h>
-#include <stdio.h>
-
-uint8_t crc8(const uint8_t *data, size_t len);
-
-#endif
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include "ke_sched.h"
+#include "stm32_uart.h"
+#include "stm32_link.h"
+#include "ke_txn.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "KE_SCHED";
+
+#define KE_SCHED_RETRY_DELAY_MS 50 // Gives the STM32 receiver time to resync after the rejected frame
+#define KE_SCHED_TXN_DRAIN_MS 7000 // Longest transaction wait (5 s config) plus its stale window
+#define KE_SCHED_PREEMPT_GAP_MS 20 // Idle line after a cut frame, the STM32 drops what it has of it
+#define KE_SCHED_MAX_PREEMPTS 3    // Cuts per bulk request, after that it goes out whole
+
+#if CONFIG_ESP32_STM32_BULK_PREEMPT
+#define KE_SCHED_BULK_PREEMPT 1
+#else
+#define KE_SCHED_BULK_PREEMPT 0
+#endif
+
+static SemaphoreHandle_t sched_lock = NULL;                    // Guards the state below
+static SemaphoreHandle_t sched_grant[KE_SCHED_CLASS_COUNT];    // Hands the link to a waiter
+static bool sched_busy = false;
+static SemaphoreHandle_t sched_tx_lock = NULL;                  // Guards the KE tx_buffer
+static bool sched_tx_preemptible = false;                       // Frame being sent may be cut, under sched_tx_lock
+static bool sched_tx_preempted = false;
+static ke_sched_class_stats_t sched_stats[KE_SCHED_CLASS_COUNT];
+
+void ke_sched_init(void)
+{
+    if (sched_lock) {
+        return;
+    }
+
+    sched_lock = xSemaphoreCreateMutex();
+    sched_tx_lock = xSemaphoreCreateMutex();
+    for (int i = 0; i < KE_SCHED_CLASS_COUNT; i++) {
+        sched_grant[i] = xSemaphoreCreateCounting(UINT16_MAX, 0);
+    }
+}
+
+/**
+ * @brief Take exclusive use of the KE link.
+ *
+ * If the link is busy the caller queues in its class. When the link is
+ * released it goes to the highest priority class with a waiter, so a
+ * config request never waits behind more than the bulk frame in flight.
+ *
+ * @param cls   Traffic class of the caller.
+ */
+void ke_sched_acquire(ke_sched_class_t cls)
+{
+    int64_t start = esp_timer_get_time();
+    ke_sched_class_stats_t *stats = &sched_stats[cls];
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    bool wait = sched_busy;
+    if (wait) {
+        stats->depth++;
+        if (stats->depth > stats->max_depth) {
+            stats->max_depth = stats->depth;
+        }
+    } else {
+        sched_busy = true;
+    }
+    xSemaphoreGive(sched_lock);
+
+    if (wait) {
+        // ke_sched_release() has already taken us off the depth count
+        xSemaphoreTake(sched_grant[cls], portMAX_DELAY);
+    }
+
+    uint32_t waited_us = (uint32_t)(esp_timer_get_time() - start);
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    stats->requests++;
+    stats->total_wait_us += waited_us;
+    if (waited_us > stats->max_wait_us) {
+        stats->max_wait_us = waited_us;
+    }
+    xSemaphoreGive(sched_lock);
+
+    ESP_LOGD(TAG, "Class %d granted after %lu us", cls, (unsigned long)waited_us);
+}
+
+/**
+ * @brief Give the KE link to the next waiter.
+ */
+void ke_sched_release(void)
+{
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    for (int i = 0; i < KE_SCHED_CLASS_COUNT; i++) {
+        if (sched_stats[i].depth > 0) {
+            // Link stays busy, ownership moves straight to the waiter
+            sched_stats[i].depth--;
+            xSemaphoreGive(sched_grant[i]);
+            xSemaphoreGive(sched_lock);
+            return;
+        }
+    }
+    sched_busy = false;
+    xSemaphoreGive(sched_lock);
+}
+
+/**
+ * @brief Take the KE tx_buffer to build and send a frame in it.
+ *
+ * Holding the link is not enough: KE_Service() builds its replies to the
+ * STM32 in the same buffer without it. Everything that can reach
+ * Generate_TX_Message() or KE_Service() takes this first.
+ */
+void ke_sched_tx_lock(void)
+{
+    xSemaphoreTake(sched_tx_lock, portMAX_DELAY);
+}
+
+/**
+ * @brief Give the KE tx_buffer back once the frame built in it has left.
+ */
+void ke_sched_tx_unlock(void)
+{
+    stm32_uart_tx_wait_done(portMAX_DELAY);
+    xSemaphoreGive(sched_tx_lock);
+}
+
+/**
+ * @brief Whether the bulk frame being sent should be cut short.
+ *
+ * Polled by stm32_tx() between UART chunks. True while a preemptible bulk
+ * frame is on the wire and a control or config request waits for the link.
+ */
+bool ke_sched_tx_should_stop(void)
+{
+    if (!sched_tx_preemptible) {
+        return false;
+    }
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    bool waiting = sched_stats[KE_SCHED_CONTROL].depth > 0 || sched_stats[KE_SCHED_CONFIG].depth > 0;
+    xSemaphoreGive(sched_lock);
+
+    if (waiting) {
+        sched_tx_preempted = true;
+    }
+    return waiting;
+}
+
+/* Build and send one frame, true if it was cut short for a higher class */
+static bool ke_sched_send(PKE_PACKET_MANAGER dev, KE_CP_OP_CODES cmd, void *args, bool preemptible)
+{
+    ke_sched_tx_lock();
+    sched_tx_preemptible = preemptible;
+    sched_tx_preempted = false;
+    Generate_TX_Message(dev, cmd, args);
+    sched_tx_preemptible = false;
+
+    bool preempted = sched_tx_preempted;
+    if (preempted) {
+        // Keep the line idle, KE_Service() replies included, until the STM32 has dropped the frame
+        vTaskDelay(pdMS_TO_TICKS(KE_SCHED_PREEMPT_GAP_MS));
+    }
+    ke_sched_tx_unlock();
+    return preempted;
+}
+
+/**
+ * @brief Send a request that is answered with a plain ACK and wait for it.
+ *
+ * The link is held for the whole round trip and released afterwards, so a
+ * bulk transfer made of several requests lets higher classes in between.
+ *
+ * With CONFIG_ESP32_STM32_BULK_PREEMPT a bulk frame is also cut between UART
+ * chunks when a control or config request is waiting. The link goes to that
+ * request and the whole frame is sent again afterwards, the KE protocol has
+ * no way to resume it. After KE_SCHED_MAX_PREEMPTS cuts it goes out whole.
+ *
+ * Replies carry no sequence number, so the request is only sent once no
+ * ke_txn reply is owed. Otherwise a late CRC or list reply could be taken
+ * for this request's ACK.
+ *
+ * @param dev           KE packet manager for the STM32 link.
+ * @param cls           Traffic class of the request.
+ * @param cmd           Opcode to send.
+ * @param args          Opcode argument passed to Generate_TX_Message().
+ * @param timeout_ms    Maximum time to wait for the response.
+ *
+ * @return Result of KE_wait_for_response().
+ */
+KE_STATUS ke_sched_request(PKE_PACKET_MANAGER dev, ke_sched_class_t cls, KE_CP_OP_CODES cmd, void *args, uint32_t timeout_ms)
+{
+    for (int preempts = 0;; preempts++) {
+        ke_sched_acquire(cls);
+
+        if (!ke_txn_wait_idle(KE_SCHED_TXN_DRAIN_MS)) {
+            ke_sched_release();
+            ESP_LOGW(TAG, "Opcode %d not sent, transaction replies still outstanding", cmd);
+            return KE_TIMEOUT;
+        }
+
+        bool preemptible = KE_SCHED_BULK_PREEMPT && cls == KE_SCHED_BULK && preempts < KE_SCHED_MAX_PREEMPTS;
+        if (!ke_sched_send(dev, cmd, args, preemptible)) {
+            break;
+        }
+
+        // Back in the queue behind whoever cut in, the next grant sends the frame from the start
+        ESP_LOGI(TAG, "Opcode %d cut short for a higher class, resending", cmd);
+        xSemaphoreTake(sched_lock, portMAX_DELAY);
+        sched_stats[cls].preempts++;
+        xSemaphoreGive(sched_lock);
+        ke_sched_release();
+    }
+
+    stm32_link_wait_begin(timeout_ms);
+    KE_STATUS status = KE_wait_for_response(dev, timeout_ms);
+    stm32_link_wait_end();
+    ke_sched_release();
+
+    if (status == KE_TIMEOUT) {
+        stm32_link_note_timeout();
+    }
+
+    return status;
+}
+
+/**
+ * @brief Send a request again on NACK, up to @p attempts times.
+ *
+ * A plain whole message retry, meant for requests the STM32 places by their
+ * own offset such as a firmware chunk, so a resend repeats only that message.
+ * The KE protocol has no sequence numbers or sub-frame CRC, there is no
+ * selective repeat below the message. The link is released between attempts.
+ *
+ * Only an explicit NACK is retried: the STM32 rejected the frame and wrote
+ * nothing. After a timeout the segment may already be written (a flash chunk
+ * cannot be programmed twice without an erase) and the late ACK could still
+ * arrive, so the timeout is returned to the caller as is. The worst case is
+ * therefore one @p timeout_ms, not @p attempts of them.
+ *
+ * @param attempts  Total sends allowed, at least one is always made.
+ *
+ * @return KE_ACK, or the status of the last attempt.
+ */
+KE_STATUS ke_sched_request_retry(PKE_PACKET_MANAGER dev, ke_sched_class_t cls, KE_CP_OP_CODES cmd, void *args,
+                                 uint32_t timeout_ms, int attempts)
+{
+    KE_STATUS status = ke_sched_request(dev, cls, cmd, args, timeout_ms);
+
+    for (int attempt = 1; attempt < attempts && status == KE_NACK; attempt++) {
+        ESP_LOGW(TAG, "Opcode %d got NACK, resending (%d of %d)", cmd, attempt + 1, attempts);
+
+        xSemaphoreTake(sched_lock, portMAX_DELAY);
+        sched_stats[cls].retries++;
+        xSemaphoreGive(sched_lock);
+
+        vTaskDelay(pdMS_TO_TICKS(KE_SCHED_RETRY_DELAY_MS));
+        status = ke_sched_request(dev, cls, cmd, args, timeout_ms);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Copy the per class link statistics.
+ */
+void ke_sched_get_stats(ke_sched_class_stats_t stats[KE_SCHED_CLASS_COUNT])
+{
+    if (!sched_lock) {
+        memset(stats, 0, sizeof(sched_stats));
+        return;
+    }
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    memcpy(stats, sched_stats, sizeof(sched_stats));
+    xSemaphoreGive(sched_lock);
+}
@@ -0,0 +1,37 @@
+#ifndef KE_SCHED_H
+#define KE_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lib_ke_protocol.h"
+
+// Traffic classes, lower value wins when several tasks wait for the link
+typedef enum {
+    KE_SCHED_CONTROL,   // Small link/state requests: CRC queries, bootloader entry
+    KE_SCHED_CONFIG,    // Config, option and PID list transfers
+    KE_SCHED_BULK,      // Background images and firmware chunks
+    KE_SCHED_CLASS_COUNT
+} ke_sched_class_t;
+
+typedef struct {
+    uint32_t requests;      // Times the link was granted
+    uint32_t depth;         // Tasks waiting right now
+    uint32_t max_depth;     // Most tasks ever waiting at once
+    uint64_t total_wait_us; // Sum of time spent waiting for the link
+    uint32_t max_wait_us;   // Longest single wait
+    uint32_t retries;       // Requests sent again after a NACK
+    uint32_t preempts;      // Frames cut short for a higher class and sent again
+} ke_sched_class_stats_t;
+
+void ke_sched_init(void);
+void ke_sched_acquire(ke_sched_class_t cls);
+void ke_sched_release(void);
+void ke_sched_tx_lock(void);
+void ke_sched_tx_unlock(void);
+bool ke_sched_tx_should_stop(void);
+KE_STATUS ke_sched_request(PKE_PACKET_MANAGER dev, ke_sched_class_t cls, KE_CP_OP_CODES cmd, void *args, uint32_t timeout_ms);
+KE_STATUS ke_sched_request_retry(PKE_PACKET_MANAGER dev, ke_sched_class_t cls, KE_CP_OP_CODES cmd, void *args,
+                                 uint32_t timeout_ms, int attempts);
+void ke_sched_get_stats(ke_sched_class_stats_t stats[KE_SCHED_CLASS_COUNT]);
+
+#endif
@@ -0,0 +1,389 @@
+#include "ke_txn.h"
+#include "ke_sched.h"
+#include "stm32_link.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "KE_TXN";
+
+#define KE_TXN_STALE_MS 1000 // How long a timed out request keeps catching its late reply
+
+typedef enum {
+    KE_TXN_FREE,
+    KE_TXN_QUEUED,      // Slot reserved, request not on the wire yet
+    KE_TXN_PENDING,     // Request sent, waiting for the reply
+    KE_TXN_DONE,        // Reply arrived, waiting for ke_txn_wait()
+    KE_TXN_STALE        // Timed out, a late reply is swallowed here instead of completing a newer request
+} ke_txn_state_t;
+
+typedef struct {
+    uint32_t seq;           // 0 while the slot is free
+    ke_txn_type_t type;
+    uint8_t key;            // View index for CRC requests, 0 otherwise
+    ke_txn_state_t state;
+    uint32_t result;
+    int64_t stale_until_us; // When a stale slot is given up on
+} ke_txn_slot_t;
+
+// Opcode sent for each transaction type
+static const KE_CP_OP_CODES ke_txn_opcodes[KE_TXN_TYPE_COUNT] = {
+    [KE_TXN_CONFIG]         = KE_CONFIG_REQUEST,
+    [KE_TXN_OPTION_LIST]    = KE_OPTION_LIST_REQUEST,
+    [KE_TXN_PID_LIST]       = KE_PID_LIST_REQUEST,
+    [KE_TXN_BACKGROUND_CRC] = KE_BACKGROUND_CRC_REQUEST,
+};
+
+// Link scheduler class for each transaction type
+static const ke_sched_class_t ke_txn_classes[KE_TXN_TYPE_COUNT] = {
+    [KE_TXN_CONFIG]         = KE_SCHED_CONFIG,
+    [KE_TXN_OPTION_LIST]    = KE_SCHED_CONFIG,
+    [KE_TXN_PID_LIST]       = KE_SCHED_CONFIG,
+    [KE_TXN_BACKGROUND_CRC] = KE_SCHED_CONTROL,
+};
+
+#define KE_TXN_IDLE_BIT (1 << KE_TXN_MAX_OUTSTANDING) // Set while no reply is owed
+
+static PKE_PACKET_MANAGER ke_txn_dev = NULL;
+static SemaphoreHandle_t ke_txn_lock = NULL;    // Guards the slot table
+static EventGroupHandle_t ke_txn_events = NULL; // Bit n set when slot n completes, plus KE_TXN_IDLE_BIT
+static ke_txn_slot_t ke_txn_slots[KE_TXN_MAX_OUTSTANDING];
+static uint32_t ke_txn_next_seq = 1;
+
+void ke_txn_init(PKE_PACKET_MANAGER dev)
+{
+    ke_txn_dev = dev;
+    if (!ke_txn_lock) {
+        ke_txn_lock = xSemaphoreCreateMutex();
+        ke_txn_events = xEventGroupCreate();
+        xEventGroupSetBits(ke_txn_events, KE_TXN_IDLE_BIT);
+    }
+}
+
+static void ke_txn_free_slot(ke_txn_slot_t *slot)
+{
+    slot->state = KE_TXN_FREE;
+    slot->seq = 0;
+}
+
+/* Give up on stale slots whose reply is overdue and update KE_TXN_IDLE_BIT, caller holds ke_txn_lock */
+static void ke_txn_update_idle(void)
+{
+    int64_t now = esp_timer_get_time();
+    bool idle = true;
+
+    for (int i = 0; i < KE_TXN_MAX_OUTSTANDING; i++) {
+        ke_txn_slot_t *s = &ke_txn_slots[i];
+        if (s->state == KE_TXN_STALE && now >= s->stale_until_us) {
+            ke_txn_free_slot(s);
+        }
+        if (s->state == KE_TXN_PENDING || s->state == KE_TXN_STALE) {
+            idle = false;
+        }
+    }
+
+    if (idle) {
+        xEventGroupSetBits(ke_txn_events, KE_TXN_IDLE_BIT);
+    } else {
+        xEventGroupClearBits(ke_txn_events, KE_TXN_IDLE_BIT);
+    }
+}
+
+/**
+ * @brief Send a request and register it as an outstanding transaction.
+ *
+ * Does not wait for the response, so several requests can be in flight and
+ * their round trips overlap. Collect each one with ke_txn_wait().
+ *
+ * The sequence ID is local: the KE protocol has no field to carry it, so
+ * replies are matched by type and key, oldest request first. The STM32
+ * answers in order, which makes that match exact as long as a late reply is
+ * never handed to a newer request, see KE_TXN_STALE.
+ *
+ * @param type  Request to send.
+ * @param key   View index for KE_TXN_BACKGROUND_CRC, ignored otherwise.
+ *
+ * @return Sequence ID of the transaction, 0 if too many are outstanding.
+ */
+uint32_t ke_txn_begin(ke_txn_type_t type, uint8_t key)
+{
+    if (!ke_txn_lock || type >= KE_TXN_TYPE_COUNT) {
+        return 0;
+    }
+
+    xSemaphoreTake(ke_txn_lock, portMAX_DELAY);
+    ke_txn_update_idle();
+
+    int slot = -1;
+    for (int i = 0; i < KE_TXN_MAX_OUTSTANDING; i++) {
+        if (ke_txn_slots[i].state == KE_TXN_FREE) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot < 0) {
+        xSemaphoreGive(ke_txn_lock);
+        ESP_LOGW(TAG, "No free transaction slot");
+        return 0;
+    }
+
+    uint32_t seq = ke_txn_next_seq++;
+    if (ke_txn_next_seq == 0) {
+        ke_txn_next_seq = 1;
+    }
+
+    ke_txn_slots[slot] = (ke_txn_slot_t){
+        .seq = seq,
+        .type = type,
+        .key = (type == KE_TXN_BACKGROUND_CRC) ? key : 0,
+        .state = KE_TXN_QUEUED,
+        .result = 0
+    };
+    xEventGroupClearBits(ke_txn_events, 1 << slot);
+    xSemaphoreGive(ke_txn_lock);
+
+    int arg = key;
+    ke_sched_acquire(ke_txn_classes[type]);
+
+    // Pending from here on: registered before sending so a fast response can never be missed,
+    // and only while holding the link so ke_txn_wait_idle() never waits on an unsent request
+    xSemaphoreTake(ke_txn_lock, portMAX_DELAY);
+    ke_txn_slots[slot].state = KE_TXN_PENDING;
+    xEventGroupClearBits(ke_txn_events, KE_TXN_IDLE_BIT);
+    xSemaphoreGive(ke_txn_lock);
+
+    ke_sched_tx_lock();
+    Generate_TX_Message(ke_txn_dev, ke_txn_opcodes[type], &arg);
+    ke_sched_tx_unlock();
+    ke_sched_release();
+
+    ESP_LOGD(TAG, "Sent txn %lu (type %d, key %u)", (unsigned long)seq, type, key);
+    return seq;
+}
+
+/**
+ * @brief Wait for the response to a transaction and release it.
+ *
+ * A transaction that times out stays behind as stale for KE_TXN_STALE_MS so
+ * its reply, should it still come, is dropped instead of answering the next
+ * request of the same type.
+ *
+ * @param seq           Sequence ID returned by ke_txn_begin().
+ * @param timeout_ms    Maximum time to wait for the response.
+ * @param result        Set to the response value (the CRC for background
+ *                      requests), may be NULL.
+ *
+ * @return true if the response arrived, false on timeout or unknown @p seq.
+ */
+bool ke_txn_wait(uint32_t seq, uint32_t timeout_ms, uint32_t *result)
+{
+    if (seq == 0 || !ke_txn_lock) {
+        return false;
+    }
+
+    int slot = -1;
+    xSemaphoreTake(ke_txn_lock, portMAX_DELAY);
+    for (int i = 0; i < KE_TXN_MAX_OUTSTANDING; i++) {
+        if (ke_txn_slots[i].state != KE_TXN_FREE && ke_txn_slots[i].state != KE_TXN_STALE &&
+            ke_txn_slots[i].seq == seq) {
+            slot = i;
+            break;
+        }
+    }
+    xSemaphoreGive(ke_txn_lock);
+
+    if (slot < 0) {
+        return false;
+    }
+
+    xEventGroupWaitBits(ke_txn_events, 1 << slot, pdTRUE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+
+    xSemaphoreTake(ke_txn_lock, portMAX_DELAY);
+    ke_txn_slot_t *s = &ke_txn_slots[slot];
+    bool done = (s->state == KE_TXN_DONE);
+    if (done) {
+        if (result) {
+            *result = s->result;
+        }
+        ke_txn_free_slot(s);
+    } else {
+        s->state = KE_TXN_STALE;
+        s->stale_until_us = esp_timer_get_time() + KE_TXN_STALE_MS * 1000LL;
+    }
+    ke_txn_update_idle();
+    xSemaphoreGive(ke_txn_lock);
+
+    if (!done) {
+        ESP_LOGW(TAG, "Txn %lu timed out", (unsigned long)seq);
+        stm32_link_note_timeout();
+    }
+    return done;
+}
+
+/**
+ * @brief Match a response from the STM32 to its outstanding request.
+ *
+ * Called from the KE receive callbacks. The oldest pending or stale
+ * transaction of the same type and key takes the response. A stale one
+ * drops it, responses nobody waits for are dropped too.
+ *
+ * @param type      Type of response received.
+ * @param key       View index for KE_TXN_BACKGROUND_CRC, ignored otherwise.
+ * @param result    Value handed to the waiter.
+ */
+void ke_txn_complete(ke_txn_type_t type, uint8_t key, uint32_t result)
+{
+    if (!ke_txn_lock) {
+        return;
+    }
+
+    if (type != KE_TXN_BACKGROUND_CRC) {
+        key = 0;
+    }
+
+    xSemaphoreTake(ke_txn_lock, portMAX_DELAY);
+    ke_txn_update_idle();
+
+    int slot = -1;
+    for (int i = 0; i < KE_TXN_MAX_OUTSTANDING; i++) {
+        ke_txn_slot_t *s = &ke_txn_slots[i];
+        if ((s->state == KE_TXN_PENDING || s->state == KE_TXN_STALE) && s->type == type && s->key == key &&
+            (slot < 0 || (int32_t)(s->seq - ke_txn_slots[slot].seq) < 0)) {
+            slot = i;
+        }
+    }
+
+    if (slot >= 0 && ke_txn_slots[slot].state == KE_TXN_STALE) {
+        ESP_LOGW(TAG, "Late reply to txn %lu dropped", (unsigned long)ke_txn_slots[slot].seq);
+        ke_txn_free_slot(&ke_txn_slots[slot]);
+    } else if (slot >= 0) {
+        ke_txn_slots[slot].state = KE_TXN_DONE;
+        ke_txn_slots[slot].result = result;
+        xEventGroupSetBits(ke_txn_events, 1 << slot);
+    }
+    ke_txn_update_idle();
+
+    xSemaphoreGive(ke_txn_lock);
+}
+
+/**
+ * @brief Wait until no transaction reply is owed by the STM32.
+ *
+ * ke_sched_request() calls this while it holds the link, so no new request
+ * can go out, before waiting for an ACK. A CRC or list reply therefore never
+ * arrives while a plain request waits in KE_wait_for_response().
+ *
+ * @param timeout_ms    Maximum time to wait.
+ *
+ * @return true once idle, false if replies are still owed after @p timeout_ms.
+ */
+bool ke_txn_wait_idle(uint32_t timeout_ms)
+{
+    if (!ke_txn_lock) {
+        return true;
+    }
+
+    int64_t deadline = esp_timer_get_time() + timeout_ms * 1000LL;
+    for (;;) {
+        xSemaphoreTake(ke_txn_lock, portMAX_DELAY);
+        ke_txn_update_idle();
+        int64_t wake = deadline;
+        for (int i = 0; i < KE_TXN_MAX_OUTSTANDING; i++) {
+            if (ke_txn_slots[i].state == KE_TXN_STALE && ke_txn_slots[i].stale_until_us < wake) {
+                wake = ke_txn_slots[i].stale_until_us;
+            }
+        }
+        xSemaphoreGive(ke_txn_lock);
+
+        int64_t now = esp_timer_get_time();
+        if (now >= deadline) {
+            return (xEventGroupGetBits(ke_txn_events) & KE_TXN_IDLE_BIT) != 0;
+        }
+
+        // Stale slots expire without an event, wake up for the first one
+        TickType_t ticks = pdMS_TO_TICKS((wake - now + 999) / 1000) + 1;
+        if (xEventGroupWaitBits(ke_txn_events, KE_TXN_IDLE_BIT, pdFALSE, pdTRUE, ticks) & KE_TXN_IDLE_BIT) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Collect the STM32 CRC of every background slot in one exchange.
+ *
+ * The protocol has no multi-slot request, so the queries are streamed back
+ * to back with up to KE_TXN_MAX_OUTSTANDING in flight and the answers are
+ * gathered as they arrive. The whole set costs about one round trip instead
+ * of one per view. Queries stop going out once the batch deadline passes or
+ * the link goes down, so a silent STM32 costs @p timeout_ms in total.
+ *
+ * @param count         Number of background slots.
+ * @param want          Slots to query, NULL for all of them.
+ * @param crcs          Set to the CRC of each answered slot.
+ * @param answered      Set for each slot the STM32 answered in time.
+ * @param timeout_ms    Maximum time for the whole batch.
+ *
+ * @return Number of slots answered.
+ */
+int ke_txn_background_crcs(int count, const bool *want, uint32_t *crcs, bool *answered, uint32_t timeout_ms)
+{
+    uint32_t seqs[KE_TXN_MAX_OUTSTANDING];
+    int views[KE_TXN_MAX_OUTSTANDING];
+    int head = 0, tail = 0; // Requests sent and collected, the window is the difference
+    int next = 0;
+    int done = 0;
+    int64_t deadline = esp_timer_get_time() + timeout_ms * 1000LL;
+
+    for (int i = 0; i < count; i++) {
+        answered[i] = false;
+    }
+
+    while (next < count || tail < head) {
+        if (next < count && (esp_timer_get_time() >= deadline || !stm32_link_available())) {
+            ESP_LOGW(TAG, "CRC batch stopped at view %d of %d", next, count);
+            next = count;
+        }
+
+        // Keep the window full, the link never idles waiting for a reply
+        while (next < count && head - tail < KE_TXN_MAX_OUTSTANDING) {
+            int view = next++;
+            if (want && !want[view]) {
+                continue;
+            }
+
+            uint32_t seq = ke_txn_begin(KE_TXN_BACKGROUND_CRC, view);
+            if (seq == 0) {
+                // Other transactions hold the slots, collect ours before trying again
+                next--;
+                break;
+            }
+            seqs[head % KE_TXN_MAX_OUTSTANDING] = seq;
+            views[head % KE_TXN_MAX_OUTSTANDING] = view;
+            head++;
+        }
+
+        if (tail == head) {
+            if (next < count) {
+                ESP_LOGW(TAG, "No transaction slot for CRC of view %d", next);
+                next++;
+            }
+            continue;
+        }
+
+        // Whatever is left of the batch, an expired wait still releases the transaction
+        int64_t remaining_us = deadline - esp_timer_get_time();
+        uint32_t wait_ms = remaining_us > 0 ? (uint32_t)((remaining_us + 999) / 1000) : 0;
+
+        int view = views[tail % KE_TXN_MAX_OUTSTANDING];
+        if (ke_txn_wait(seqs[tail % KE_TXN_MAX_OUTSTANDING], wait_ms, &crcs[view])) {
+            answered[view] = true;
+            done++;
+        }
+        tail++;
+    }
+
+    return done;
+}
@@ -0,0 +1,26 @@
+#ifndef KE_TXN_H
+#define KE_TXN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lib_ke_protocol.h"
+
+#define KE_TXN_MAX_OUTSTANDING 8 // Requests that may wait for a response at once
+
+// Requests that are answered through a KE callback and can be matched
+typedef enum {
+    KE_TXN_CONFIG,
+    KE_TXN_OPTION_LIST,
+    KE_TXN_PID_LIST,
+    KE_TXN_BACKGROUND_CRC,
+    KE_TXN_TYPE_COUNT
+} ke_txn_type_t;
+
+void ke_txn_init(PKE_PACKET_MANAGER dev);
+uint32_t ke_txn_begin(ke_txn_type_t type, uint8_t key);
+bool ke_txn_wait(uint32_t seq, uint32_t timeout_ms, uint32_t *result);
+void ke_txn_complete(ke_txn_type_t type, uint8_t key, uint32_t result);
+bool ke_txn_wait_idle(uint32_t timeout_ms);
+int ke_txn_background_crcs(int count, const bool *want, uint32_t *crcs, bool *answered, uint32_t timeout_ms);
+
+#endif
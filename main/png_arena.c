@@ -0,0 +1,138 @@
+#include "png_arena.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "PNGArena";
+
+#define PNG_ARENA_SIZE     (96 * 1024) // libpng peaks near 58 KB and the fast decoder near 60 KB on a 1024 px row
+#define PNG_ARENA_POOL     2           // An upload ingest and a sync can decode at the same time
+#define PNG_ARENA_INTERNAL 0           // Keep the pool in internal RAM, costs PNG_ARENA_POOL * PNG_ARENA_SIZE for good
+#define PNG_ARENA_ALIGN    16
+
+#if PNG_ARENA_INTERNAL
+#define PNG_ARENA_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#else
+#define PNG_ARENA_CAPS MALLOC_CAP_SPIRAM
+#endif
+
+/*
+ * Bump allocator for one PNG decode session. libpng and the fast decoder
+ * allocate a fixed set of buffers up front and free them all at the end, so
+ * nothing is handed back until the session releases the whole arena. The
+ * arenas are allocated once and reused, decodes no longer churn the internal
+ * heap WiFi and lwIP live in.
+ */
+struct png_arena {
+    uint8_t *base;
+    size_t used;
+    bool in_use;
+};
+
+static png_arena_t arena_pool[PNG_ARENA_POOL];
+static png_arena_stats_t arena_stats;
+static portMUX_TYPE arena_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Take an arena for one decode session.
+ *
+ * @return Arena, or NULL if all are busy or the pool cannot be allocated. The
+ *         allocation functions accept NULL and then use the PSRAM heap.
+ */
+png_arena_t *png_arena_acquire(void)
+{
+    png_arena_t *arena = NULL;
+
+    portENTER_CRITICAL(&arena_lock);
+    arena_stats.sessions++;
+    for (int i = 0; i < PNG_ARENA_POOL; i++) {
+        if (!arena_pool[i].in_use) {
+            arena = &arena_pool[i];
+            arena->in_use = true;
+            break;
+        }
+    }
+    if (!arena) {
+        arena_stats.pool_misses++;
+    }
+    portEXIT_CRITICAL(&arena_lock);
+
+    if (arena && !arena->base) {
+        arena->base = heap_caps_aligned_alloc(PNG_ARENA_ALIGN, PNG_ARENA_SIZE, PNG_ARENA_CAPS);
+        if (!arena->base) {
+            ESP_LOGW(TAG, "No memory for a %d KB decode arena", PNG_ARENA_SIZE / 1024);
+            png_arena_release(arena);
+            return NULL;
+        }
+    }
+
+    if (arena) {
+        arena->used = 0;
+    }
+    return arena;
+}
+
+/**
+ * @brief Allocate from a session's arena.
+ *
+ * Requests that do not fit come from the PSRAM heap, png_arena_free() tells
+ * the two apart.
+ */
+void *png_arena_alloc(png_arena_t *arena, size_t size)
+{
+    if (arena) {
+        size_t offset = (arena->used + PNG_ARENA_ALIGN - 1) & ~(size_t)(PNG_ARENA_ALIGN - 1);
+        if (size <= PNG_ARENA_SIZE && offset <= PNG_ARENA_SIZE - size) {
+            arena->used = offset + size;
+            return arena->base + offset;
+        }
+
+        portENTER_CRITICAL(&arena_lock);
+        arena_stats.overflow_allocs++;
+        portEXIT_CRITICAL(&arena_lock);
+    }
+
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+}
+
+/**
+ * @brief Free a session allocation, a no-op for memory inside the arena.
+ */
+void png_arena_free(png_arena_t *arena, void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    if (arena && (uint8_t *)ptr >= arena->base && (uint8_t *)ptr < arena->base + PNG_ARENA_SIZE) {
+        return; // Reclaimed in one go by png_arena_release()
+    }
+    heap_caps_free(ptr);
+}
+
+/**
+ * @brief End a decode session, everything allocated from the arena is gone.
+ */
+void png_arena_release(png_arena_t *arena)
+{
+    if (!arena) {
+        return;
+    }
+
+    portENTER_CRITICAL(&arena_lock);
+    if (arena->used > arena_stats.peak_used) {
+        arena_stats.peak_used = arena->used;
+    }
+    arena->used = 0;
+    arena->in_use = false;
+    portEXIT_CRITICAL(&arena_lock);
+}
+
+void png_arena_get_stats(png_arena_stats_t *stats)
+{
+    portENTER_CRITICAL(&arena_lock);
+    memcpy(stats, &arena_stats, sizeof(*stats));
+    portEXIT_CRITICAL(&arena_lock);
+}
@@ -0,0 +1,22 @@
+#ifndef PNG_ARENA_H
+#define PNG_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct png_arena png_arena_t;
+
+typedef struct {
+    uint32_t sessions;          // Decode sessions started
+    uint32_t pool_misses;       // Sessions that found every arena busy
+    uint32_t overflow_allocs;   // Allocations that did not fit their arena
+    uint32_t peak_used;         // Most bytes one session took from its arena
+} png_arena_stats_t;
+
+png_arena_t *png_arena_acquire(void);
+void *png_arena_alloc(png_arena_t *arena, size_t size);
+void png_arena_free(png_arena_t *arena, void *ptr);
+void png_arena_release(png_arena_t *arena);
+void png_arena_get_stats(png_arena_stats_t *stats);
+
+#endif
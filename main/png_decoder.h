@@ -0,0 +1,43 @@
+#ifndef PNG_DECODER_H
+#define PNG_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "bg_format.h"
+
+typedef enum {
+    PNG_DECODE_OK = 0,
+    PNG_DECODE_ERROR = -1,        // Not a valid PNG, or it could not be read
+    PNG_DECODE_UNSUPPORTED = -2,  // Valid PNG this backend does not handle
+} png_decode_status_t;
+
+/**
+ * @brief One PNG decode: where the rows go, in which format, and what is reported back.
+ */
+typedef struct {
+    uint8_t *frame;         // Output in @p format, NULL to only checksum the rows
+    uint32_t frame_size;
+    bg_format_t format;     // Rows are decoded to BGRA and packed to this
+    bool want_crc;
+    uint32_t crc;           // CRC-32 of the output rows, set if want_crc
+    uint32_t width;
+    uint32_t height;
+    uint32_t len;           // Bytes written to frame
+} png_decode_job_t;
+
+/**
+ * @brief PNG decoder backend.
+ *
+ * decode() starts at the PNG signature and leaves @p fp anywhere, the caller
+ * seeks back before trying another backend.
+ */
+typedef struct {
+    const char *name;
+    png_decode_status_t (*decode)(FILE *fp, png_decode_job_t *job);
+} png_decoder_t;
+
+extern const png_decoder_t png_decoder_libpng;
+extern const png_decoder_t png_decoder_fast;
+
+#endif
@@ -0,0 +1,358 @@
+#include "png_decoder.h"
+#include "checksum.h"
+#include "png_arena.h"
+#include "esp_log.h"
+#include "rom/miniz.h"
+#include <string.h>
+
+static const char *TAG = "PNGFast";
+
+/*
+ * Fast path for the backgrounds the webapp actually stores: 8-bit RGB or
+ * RGBA, not interlaced, no colour key. The zlib stream is inflated by the
+ * table-driven tinfl in ROM, so the hot loop runs without flash cache misses,
+ * into a full 32 KB window. Rows are unfiltered in a pair of row buffers and
+ * written to the frame once, already in BGRA. All working memory comes from a
+ * decode arena.
+ */
+
+#define PNG_SIG_SIZE       8
+#define PNG_IHDR_SIZE      13
+#define PNG_FAST_IN_SIZE   4096
+
+#define PNG_CHUNK_IHDR 0x49484452
+#define PNG_CHUNK_IDAT 0x49444154
+#define PNG_CHUNK_tRNS 0x74524E53
+
+#define PNG_COLOR_RGB  2
+#define PNG_COLOR_RGBA 6
+
+// Rows start 3 bytes into their buffer so the pixels after the filter byte are word aligned
+#define PNG_ROW_PAD    3
+
+typedef struct {
+    tinfl_decompressor inflator;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+    uint8_t in[PNG_FAST_IN_SIZE];
+} png_fast_inflate_t;
+
+typedef struct {
+    FILE *fp;
+    png_decode_job_t *job;
+    png_fast_inflate_t *inflate;
+    uint32_t idat_left;     // Bytes of the current IDAT chunk not read yet
+    uint32_t width;
+    uint32_t height;
+    uint32_t bpp;           // Bytes per pixel, 3 or 4
+    uint32_t stride;        // Filter byte plus pixels
+    uint32_t row_fill;
+    uint32_t y;
+    uint8_t *rows;
+    uint8_t *cur;
+    uint8_t *prev;
+    uint32_t *out_row;      // Used unless rows go straight into the frame
+    bool direct;            // BGRA rows written in place, the frame is word aligned
+    uint32_t crc;
+} png_fast_t;
+
+static const uint8_t png_signature[PNG_SIG_SIZE] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+static bool read_be32(FILE *fp, uint32_t *value)
+{
+    uint8_t b[4];
+    if (fread(b, 1, 4, fp) != 4) {
+        return false;
+    }
+    *value = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    return true;
+}
+
+/**
+ * @brief Check the header and skip to the first IDAT chunk.
+ */
+static png_decode_status_t png_fast_read_header(png_fast_t *dec)
+{
+    uint8_t sig[PNG_SIG_SIZE];
+    if (fread(sig, 1, sizeof(sig), dec->fp) != sizeof(sig) || memcmp(sig, png_signature, sizeof(sig)) != 0) {
+        return PNG_DECODE_ERROR;
+    }
+
+    uint32_t len, type;
+    uint8_t ihdr[PNG_IHDR_SIZE];
+    if (!read_be32(dec->fp, &len) || !read_be32(dec->fp, &type) ||
+        type != PNG_CHUNK_IHDR || len != PNG_IHDR_SIZE ||
+        fread(ihdr, 1, sizeof(ihdr), dec->fp) != sizeof(ihdr)) {
+        return PNG_DECODE_ERROR;
+    }
+
+    dec->width = ((uint32_t)ihdr[0] << 24) | ((uint32_t)ihdr[1] << 16) | ((uint32_t)ihdr[2] << 8) | ihdr[3];
+    dec->height = ((uint32_t)ihdr[4] << 24) | ((uint32_t)ihdr[5] << 16) | ((uint32_t)ihdr[6] << 8) | ihdr[7];
+    uint8_t bit_depth = ihdr[8];
+    uint8_t color_type = ihdr[9];
+    uint8_t interlace = ihdr[12];
+
+    if (bit_depth != 8 || (color_type != PNG_COLOR_RGB && color_type != PNG_COLOR_RGBA) ||
+        ihdr[10] != 0 || ihdr[11] != 0 || interlace != 0 ||
+        dec->width == 0 || dec->height == 0 || dec->width > 0x10000) {
+        return PNG_DECODE_UNSUPPORTED;
+    }
+    dec->bpp = (color_type == PNG_COLOR_RGBA) ? 4 : 3;
+    dec->stride = 1 + dec->width * dec->bpp;
+
+    // Skip the IHDR CRC and every chunk up to the image data
+    if (fseek(dec->fp, 4, SEEK_CUR) != 0) {
+        return PNG_DECODE_ERROR;
+    }
+    for (;;) {
+        if (!read_be32(dec->fp, &len) || !read_be32(dec->fp, &type)) {
+            return PNG_DECODE_ERROR;
+        }
+        if (type == PNG_CHUNK_IDAT) {
+            dec->idat_left = len;
+            return PNG_DECODE_OK;
+        }
+        if (type == PNG_CHUNK_tRNS) {
+            // Colour key transparency, libpng turns it into alpha
+            return PNG_DECODE_UNSUPPORTED;
+        }
+        if (fseek(dec->fp, (long)len + 4, SEEK_CUR) != 0) {
+            return PNG_DECODE_ERROR;
+        }
+    }
+}
+
+/**
+ * @brief Read the next piece of the zlib stream, following consecutive IDAT chunks.
+ *
+ * @return Number of bytes read into the input buffer, 0 once the image data ends.
+ */
+static size_t png_fast_read_idat(png_fast_t *dec)
+{
+    while (dec->idat_left == 0) {
+        uint32_t len, type;
+        if (fseek(dec->fp, 4, SEEK_CUR) != 0 || !read_be32(dec->fp, &len) ||
+            !read_be32(dec->fp, &type) || type != PNG_CHUNK_IDAT) {
+            return 0;
+        }
+        dec->idat_left = len;
+    }
+
+    size_t want = dec->idat_left < PNG_FAST_IN_SIZE ? dec->idat_left : PNG_FAST_IN_SIZE;
+    size_t got = fread(dec->inflate->in, 1, want, dec->fp);
+    dec->idat_left -= got;
+    return got;
+}
+
+static inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int p = (int)a + b - c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+    if (pa <= pb && pa <= pc) return a;
+    return (pb <= pc) ? b : c;
+}
+
+/* Undo the row filter of dec->cur against the previous row */
+static bool png_fast_unfilter(png_fast_t *dec)
+{
+    uint8_t *row = dec->cur + 1;
+    const uint8_t *up = dec->prev + 1;
+    uint32_t n = dec->stride - 1;
+    uint32_t bpp = dec->bpp;
+
+    switch (dec->cur[0]) {
+    case 0: // None
+        break;
+    case 1: // Sub
+        for (uint32_t i = bpp; i < n; i++) row[i] += row[i - bpp];
+        break;
+    case 2: // Up
+        for (uint32_t i = 0; i < n; i++) row[i] += up[i];
+        break;
+    case 3: // Average
+        for (uint32_t i = 0; i < bpp; i++) row[i] += up[i] >> 1;
+        for (uint32_t i = bpp; i < n; i++) row[i] += (row[i - bpp] + up[i]) >> 1;
+        break;
+    case 4: // Paeth
+        for (uint32_t i = 0; i < bpp; i++) row[i] += up[i];
+        for (uint32_t i = bpp; i < n; i++) row[i] += paeth(row[i - bpp], up[i], up[i - bpp]);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/* Write the unfiltered row to the frame as BGRA, little endian words are B, G, R, A,
+ * then pack it if the job wants another format */
+static void png_fast_emit(png_fast_t *dec)
+{
+    png_decode_job_t *job = dec->job;
+    bool pack = (job->format != BG_FORMAT_BGRA8888);
+    uint32_t *out = dec->direct ? (uint32_t *)(job->frame + (size_t)dec->y * dec->width * 4) : dec->out_row;
+    // Word aligned, the row buffers come from the arena and start PNG_ROW_PAD in
+    const uint8_t *px = dec->cur + 1;
+
+    if (dec->bpp == 4) {
+        const uint32_t *in = (const uint32_t *)px;
+        for (uint32_t x = 0; x < dec->width; x++) {
+            uint32_t p = in[x];
+            out[x] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+        }
+    } else {
+        for (uint32_t x = 0; x < dec->width; x++, px += 3) {
+            out[x] = 0xFF000000 | ((uint32_t)px[0] << 16) | ((uint32_t)px[1] << 8) | px[2];
+        }
+    }
+
+    uint32_t out_bytes = dec->width * bg_format_bpp(job->format);
+    uint8_t *packed = (uint8_t *)out;
+    if (pack) {
+        packed = job->frame ? job->frame + (size_t)dec->y * out_bytes : (uint8_t *)out;
+        bg_format_pack_row(job->format, (const uint8_t *)out, packed, dec->width, dec->y);
+    } else if (job->frame && !dec->direct) {
+        // Word stores into a misaligned frame would fault on Xtensa
+        memcpy(job->frame + (size_t)dec->y * out_bytes, out, out_bytes);
+    }
+
+    if (job->want_crc) {
+        dec->crc = crc32_update(dec->crc, packed, out_bytes);
+    }
+}
+
+/* Collect inflated bytes into rows and finish each row as it completes */
+static bool png_fast_rows(png_fast_t *dec, const uint8_t *data, size_t len)
+{
+    while (len > 0 && dec->y < dec->height) {
+        size_t take = dec->stride - dec->row_fill;
+        if (take > len) take = len;
+
+        memcpy(dec->cur + dec->row_fill, data, take);
+        dec->row_fill += take;
+        data += take;
+        len -= take;
+
+        if (dec->row_fill == dec->stride) {
+            if (!png_fast_unfilter(dec)) {
+                return false;
+            }
+            png_fast_emit(dec);
+
+            uint8_t *tmp = dec->prev;
+            dec->prev = dec->cur;
+            dec->cur = tmp;
+            dec->row_fill = 0;
+            dec->y++;
+        }
+    }
+    return true;
+}
+
+static png_decode_status_t png_fast_inflate(png_fast_t *dec)
+{
+    png_fast_inflate_t *inf = dec->inflate;
+    size_t in_len = png_fast_read_idat(dec);
+    size_t in_ofs = 0;
+    size_t dict_ofs = 0;
+
+    tinfl_init(&inf->inflator);
+
+    for (;;) {
+        size_t in_size = in_len - in_ofs;
+        size_t out_size = TINFL_LZ_DICT_SIZE - dict_ofs;
+        tinfl_status status = tinfl_decompress(&inf->inflator, inf->in + in_ofs, &in_size,
+                                               inf->dict, inf->dict + dict_ofs, &out_size,
+                                               TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        in_ofs += in_size;
+
+        if (out_size > 0 && !png_fast_rows(dec, inf->dict + dict_ofs, out_size)) {
+            ESP_LOGW(TAG, "Bad filter type in row %lu", (unsigned long)dec->y);
+            return PNG_DECODE_ERROR;
+        }
+        dict_ofs = (dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status == TINFL_STATUS_DONE) {
+            break;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            in_len = png_fast_read_idat(dec);
+            in_ofs = 0;
+            if (in_len == 0) {
+                ESP_LOGW(TAG, "Image data ends early");
+                return PNG_DECODE_ERROR;
+            }
+        } else if (status < 0) {
+            ESP_LOGW(TAG, "Inflate failed (%d)", status);
+            return PNG_DECODE_ERROR;
+        }
+    }
+
+    return (dec->y == dec->height) ? PNG_DECODE_OK : PNG_DECODE_ERROR;
+}
+
+/**
+ * @brief Fast backend, 8-bit RGB/RGBA non-interlaced PNGs only.
+ *
+ * @return PNG_DECODE_UNSUPPORTED for any other PNG, or if its buffers cannot
+ *         be allocated, so the caller can fall back to libpng.
+ */
+static png_decode_status_t png_fast_decode(FILE *fp, png_decode_job_t *job)
+{
+    png_fast_t dec = {
+        .fp = fp,
+        .job = job,
+        .crc = CHECKSUM_CRC32_SEED,
+    };
+
+    png_decode_status_t status = png_fast_read_header(&dec);
+    if (status != PNG_DECODE_OK) {
+        return status;
+    }
+
+    // 64-bit so a crafted header cannot wrap the size past the check, every row offset fits once it passes
+    uint64_t frame_len = (uint64_t)dec.width * dec.height * bg_format_bpp(job->format);
+    if (job->frame && frame_len > job->frame_size) {
+        ESP_LOGE(TAG, "Provided buffer too small. Required: %llu, Given: %lu",
+                 (unsigned long long)frame_len, (unsigned long)job->frame_size);
+        return PNG_DECODE_ERROR;
+    }
+
+    uint32_t row_size = (PNG_ROW_PAD + dec.stride + 3) & ~3u;
+    png_arena_t *arena = png_arena_acquire();
+    dec.inflate = png_arena_alloc(arena, sizeof(png_fast_inflate_t));
+    dec.rows = png_arena_alloc(arena, 2 * row_size);
+    // A frame inside tx_buffer after the KE header need not be word aligned
+    dec.direct = job->frame && job->format == BG_FORMAT_BGRA8888 && ((uintptr_t)job->frame & 3) == 0;
+    if (!dec.direct) {
+        dec.out_row = png_arena_alloc(arena, dec.width * 4);
+    }
+
+    if (!dec.inflate || !dec.rows || (!dec.direct && !dec.out_row) || ((uintptr_t)dec.rows & 3)) {
+        status = PNG_DECODE_UNSUPPORTED;
+    } else {
+        // The row above the first one is all zeros
+        memset(dec.rows, 0, 2 * row_size);
+        dec.cur = dec.rows + PNG_ROW_PAD;
+        dec.prev = dec.rows + row_size + PNG_ROW_PAD;
+        status = png_fast_inflate(&dec);
+    }
+
+    png_arena_free(arena, dec.inflate);
+    png_arena_free(arena, dec.rows);
+    png_arena_free(arena, dec.out_row);
+    png_arena_release(arena);
+
+    if (status == PNG_DECODE_OK) {
+        job->crc = dec.crc;
+        job->width = dec.width;
+        job->height = dec.height;
+        job->len = job->frame ? (uint32_t)frame_len : 0;
+    }
+    return status;
+}
+
+const png_decoder_t png_decoder_fast = {
+    .name = "fast",
+    .decode = png_fast_decode,
+};
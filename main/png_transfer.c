@@ -1,189 +1,404 @@
 #include "png_transfer.h"
+#include "png_decoder.h"
+#include "png_arena.h"
 #include "png.h"
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_heap_caps.h"
 #include "driver/uart.h"
+#include "checksum.h"
+#include <stdlib.h>
+
+#define PNG_USE_FAST_DECODER 1 // In-house inflate for 8-bit RGB/RGBA, libpng for everything else
 
 static const char *TAG = "PNG";
 
-static uint32_t crc32_table[256];
+/**
+ * @brief Configure libpng to emit 8-bit BGRA rows, the layout the STM32 stores.
+ *
+ * The R/B swap is done by png_set_bgr inside libpng's own row transform, so
+ * the decoded rows need no extra pass before they are checksummed or sent.
+ */
+static void png_set_bgra_output(png_structp png_ptr, png_infop info_ptr) {
+    png_byte color_type = png_get_color_type(png_ptr, info_ptr);
+    png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
 
-void crc32_init_table(void) {
-    for (uint32_t i = 0; i < 256; ++i) {
-        uint32_t c = i;
-        for (int j = 0; j < 8; ++j) {
-            if (c & 1)
-                c = 0xEDB88320L ^ (c >> 1);
-            else
-                c >>= 1;
-        }
-        crc32_table[i] = c;
-    }
+    if (bit_depth == 16) png_set_strip_16(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png_ptr);
+    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png_ptr);
+
+    png_set_bgr(png_ptr);                            // RGB → BGR
+    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER); // Force BGRA
+    png_set_gray_to_rgb(png_ptr);
+
+    png_read_update_info(png_ptr, info_ptr);
 }
 
-uint32_t crc32_update(uint32_t crc, const uint8_t *buf, size_t len) {
-    crc ^= 0xFFFFFFFF;
-    for (size_t i = 0; i < len; ++i) {
-        crc = (crc >> 8) ^ crc32_table[(crc ^ buf[i]) & 0xFF];
-    }
-    return crc ^ 0xFFFFFFFF;
+/* libpng memory hooks, the arena comes in as the read struct's mem_ptr */
+static png_voidp png_arena_malloc_fn(png_structp png_ptr, png_alloc_size_t size) {
+    return png_arena_alloc(png_get_mem_ptr(png_ptr), size);
 }
 
-/**
- * @brief Decode PNG into caller-provided buffer (must be large enough).
- *        Uses in-place row-by-row decoding (no row_pointers allocation).
- *
- * @param fp            Pointer to open PNG file.
- * @param buffer        Target buffer in PSRAM (must be large enough).
- * @param buffer_size   Size of target buffer in bytes.
- *
- * @return Total number of bytes written to buffer on success, -1 on failure.
- */
-int decode_png_to_rgba(const FILE *fp, uint8_t *buffer, uint32_t buffer_size) {
-    if (!fp || !buffer) {
-        ESP_LOGE(TAG, "Invalid input: file or buffer is NULL");
-        return -1;
-    }
+static void png_arena_free_fn(png_structp png_ptr, png_voidp ptr) {
+    png_arena_free(png_get_mem_ptr(png_ptr), ptr);
+}
 
+/* Read struct whose libpng and zlib state all lives in @p arena */
+static png_structp png_create_arena_read_struct(png_arena_t *arena) {
+    return png_create_read_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+                                    arena, png_arena_malloc_fn, png_arena_free_fn);
+}
+
+static png_decode_status_t png_libpng_decode_session(FILE *fp, png_decode_job_t *job, png_arena_t *arena) {
     png_byte header[8];
-    fread(header, 1, 8, fp);
-    if (png_sig_cmp(header, 0, 8)) {
+    if (fread(header, 1, 8, fp) != 8 || png_sig_cmp(header, 0, 8)) {
         ESP_LOGE(TAG, "Not a PNG file");
-        return -1;
+        return PNG_DECODE_ERROR;
     }
 
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_structp png_ptr = png_create_arena_read_struct(arena);
     if (!png_ptr) {
         ESP_LOGE(TAG, "Failed to create PNG read struct");
-        return -1;
+        return PNG_DECODE_ERROR;
     }
 
     png_infop info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) {
         png_destroy_read_struct(&png_ptr, NULL, NULL);
         ESP_LOGE(TAG, "Failed to create PNG info struct");
-        return -1;
+        return PNG_DECODE_ERROR;
     }
 
+    // Used when checksumming without a frame, or when rows are packed to another format
+    uint8_t *volatile scratch_row = NULL;
+
     if (setjmp(png_jmpbuf(png_ptr))) {
         ESP_LOGE(TAG, "PNG error during decoding");
         png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        return -1;
+        png_arena_free(arena, scratch_row);
+        return PNG_DECODE_ERROR;
     }
 
     png_init_io(png_ptr, fp);
     png_set_sig_bytes(png_ptr, 8);
     png_read_info(png_ptr, info_ptr);
 
-    int width = png_get_image_width(png_ptr, info_ptr);
-    int height = png_get_image_height(png_ptr, info_ptr);
-    png_byte color_type = png_get_color_type(png_ptr, info_ptr);
-    png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-
-    if (bit_depth == 16) png_set_strip_16(png_ptr);
-    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png_ptr);
-    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png_ptr);
-    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png_ptr);
+    uint32_t width = png_get_image_width(png_ptr, info_ptr);
+    uint32_t height = png_get_image_height(png_ptr, info_ptr);
 
-    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER); // Force RGBA
-    png_set_gray_to_rgb(png_ptr);
-
-    png_read_update_info(png_ptr, info_ptr);
+    png_set_bgra_output(png_ptr, info_ptr);
 
     size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    uint32_t total_bytes = height * rowbytes;
+    bool pack = (job->format != BG_FORMAT_BGRA8888);
+    uint32_t out_bytes = width * bg_format_bpp(job->format);
+    uint64_t total_bytes = (uint64_t)height * out_bytes; // Cannot wrap past the check below
 
-    if (total_bytes > buffer_size) {
-        ESP_LOGE(TAG, "Provided buffer too small. Required: %lu, Given: %lu", total_bytes, buffer_size);
+    if (job->frame && total_bytes > job->frame_size) {
+        ESP_LOGE(TAG, "Provided buffer too small. Required: %llu, Given: %lu",
+                 (unsigned long long)total_bytes, (unsigned long)job->frame_size);
         png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        return -1;
+        return PNG_DECODE_ERROR;
     }
 
-    for (int y = 0; y < height; y++) {
-        uint8_t *row = buffer + y * rowbytes;
+    if (!job->frame || pack) {
+        scratch_row = png_arena_alloc(arena, rowbytes);
+        if (!scratch_row) {
+            png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+            return PNG_DECODE_ERROR;
+        }
+    }
+
+    uint32_t crc = CHECKSUM_CRC32_SEED;
+
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *row = (job->frame && !pack) ? job->frame + (size_t)y * rowbytes : scratch_row;
         png_read_row(png_ptr, row, NULL);
 
-        // Optional: Convert RGBA → BGRA (for STM32 compatibility)
-        for (int x = 0; x < width; x++) {
-            uint8_t *pixel = &row[x * 4];
-            uint8_t temp = pixel[0];    // R
-            pixel[0] = pixel[2];        // B
-            pixel[2] = temp;            // R → B
+        uint8_t *out = job->frame ? job->frame + (size_t)y * out_bytes : row;
+        if (pack) {
+            bg_format_pack_row(job->format, row, out, width, y);
+        }
+
+        if (job->want_crc) {
+            crc = crc32_update(crc, out, out_bytes);
         }
     }
 
+    png_arena_free(arena, scratch_row);
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
-    return total_bytes; // success
+    job->crc = crc;
+    job->width = width;
+    job->height = height;
+    job->len = job->frame ? (uint32_t)total_bytes : 0;
+    return PNG_DECODE_OK;
 }
 
-uint32_t crc32_png_rgba(FILE *fp) {
-    if (!fp) return 0;
+/**
+ * @brief libpng backend, decodes any PNG libpng can read into BGRA rows.
+ */
+static png_decode_status_t png_libpng_decode(FILE *fp, png_decode_job_t *job) {
+    png_arena_t *arena = png_arena_acquire();
+    png_decode_status_t status = png_libpng_decode_session(fp, job, arena);
+    png_arena_release(arena);
+    return status;
+}
 
-    crc32_init_table();
+const png_decoder_t png_decoder_libpng = {
+    .name = "libpng",
+    .decode = png_libpng_decode,
+};
 
-    png_byte header[8];
-    fread(header, 1, 8, fp);
-    if (png_sig_cmp(header, 0, 8)) return 0;
+/**
+ * @brief Run a decode job, on the fast backend when it can take the image.
+ *
+ * Anything the fast backend turns down or fails on is decoded again from the
+ * start of the file with libpng.
+ */
+static png_decode_status_t png_decode(FILE *fp, png_decode_job_t *job) {
+#if PNG_USE_FAST_DECODER
+    long start = ftell(fp);
+    png_decode_status_t status = png_decoder_fast.decode(fp, job);
+    if (status == PNG_DECODE_OK) {
+        return status;
+    }
 
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_ptr) return 0;
+    if (status == PNG_DECODE_ERROR) {
+        ESP_LOGW(TAG, "Fast decoder failed, retrying with libpng");
+    }
+    if (start < 0 || fseek(fp, start, SEEK_SET) != 0) {
+        return PNG_DECODE_ERROR;
+    }
+#endif
 
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_read_struct(&png_ptr, NULL, NULL);
-        return 0;
+    return png_decoder_libpng.decode(fp, job);
+}
+
+/**
+ * @brief Decode PNG into caller-provided buffer (must be large enough).
+ *        Uses in-place row-by-row decoding (no row_pointers allocation).
+ *
+ * @param fp            Pointer to open PNG file.
+ * @param buffer        Target buffer in PSRAM (must be large enough).
+ * @param buffer_size   Size of target buffer in bytes.
+ *
+ * @return Total number of bytes written to buffer on success, -1 on failure.
+ */
+int decode_png_to_rgba(const FILE *fp, uint8_t *buffer, uint32_t buffer_size) {
+    return decode_png_to_rgba_crc((FILE *)fp, buffer, buffer_size, NULL, NULL, NULL);
+}
+
+/**
+ * @brief Decode PNG into caller-provided buffer and CRC the output in the same pass.
+ *
+ * Each row is checksummed right after it is decoded, while it is still in
+ * cache, so a background that is both checked and sent is decoded only once.
+ *
+ * @param fp            Pointer to open PNG file.
+ * @param buffer        Target buffer in PSRAM (must be large enough).
+ * @param buffer_size   Size of target buffer in bytes.
+ * @param crc           Set to the CRC-32 of the decoded pixels, may be NULL.
+ * @param img_width     Set to the image width, may be NULL.
+ * @param img_height    Set to the image height, may be NULL.
+ *
+ * @return Total number of bytes written to buffer on success, -1 on failure.
+ */
+int decode_png_to_rgba_crc(FILE *fp, uint8_t *buffer, uint32_t buffer_size,
+                           uint32_t *crc, uint32_t *img_width, uint32_t *img_height) {
+    if (!fp || !buffer) {
+        ESP_LOGE(TAG, "Invalid input: file or buffer is NULL");
+        return -1;
     }
 
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    png_decode_job_t job = {
+        .frame = buffer,
+        .frame_size = buffer_size,
+        .format = BG_WIRE_FORMAT,
+        .want_crc = (crc != NULL),
+    };
+    if (png_decode(fp, &job) != PNG_DECODE_OK) {
+        return -1;
+    }
+
+    if (crc) *crc = job.crc;
+    if (img_width) *img_width = job.width;
+    if (img_height) *img_height = job.height;
+
+    return job.len; // success
+}
+
+/**
+ * @brief CRC-32 of a PNG as decoded BG_WIRE_FORMAT pixels, the same bytes the STM32 stores.
+ *
+ * @param fp        Pointer to open PNG file.
+ * @param width     Set to the image width on success, may be NULL.
+ * @param height    Set to the image height on success, may be NULL.
+ *
+ * @return CRC of the decoded image, 0 on failure.
+ */
+uint32_t crc32_png_rgba(FILE *fp, uint32_t *width, uint32_t *height) {
+    if (!fp) return 0;
+
+    png_decode_job_t job = {
+        .format = BG_WIRE_FORMAT,
+        .want_crc = true,
+    };
+    if (png_decode(fp, &job) != PNG_DECODE_OK) {
         return 0;
     }
 
-    png_init_io(png_ptr, fp);
-    png_set_sig_bytes(png_ptr, 8);
-    png_read_info(png_ptr, info_ptr);
+    if (width) *width = job.width;
+    if (height) *height = job.height;
+    return job.crc;
+}
 
-    int width = png_get_image_width(png_ptr, info_ptr);
-    int height = png_get_image_height(png_ptr, info_ptr);
-    png_byte color_type = png_get_color_type(png_ptr, info_ptr);
-    png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+struct png_stream {
+    png_arena_t *arena;
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_stream_info_cb_t info_cb;
+    png_stream_row_cb_t row_cb;
+    void *arg;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowbytes;
+    uint8_t *out_row;           // Row packed to BG_WIRE_FORMAT, NULL when rows are sent as decoded
+    uint32_t out_bytes;
+    uint32_t rows;
+    uint32_t crc;
+    bool done;
+    bool failed;
+};
+
+static void png_stream_on_info(png_structp png_ptr, png_infop info_ptr) {
+    png_stream_t *stream = png_get_progressive_ptr(png_ptr);
+
+    // Interlaced rows arrive in several passes and are not final until the last one
+    if (png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE) {
+        png_error(png_ptr, "Interlaced PNG not supported");
+    }
 
-    if (bit_depth == 16) png_set_strip_16(png_ptr);
-    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png_ptr);
-    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png_ptr);
-    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png_ptr);
+    stream->width = png_get_image_width(png_ptr, info_ptr);
+    stream->height = png_get_image_height(png_ptr, info_ptr);
+    if (stream->info_cb && !stream->info_cb(stream->width, stream->height, stream->arg)) {
+        png_error(png_ptr, "PNG rejected");
+    }
 
-    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER); // Force RGBA
-    png_set_gray_to_rgb(png_ptr);
+    png_set_bgra_output(png_ptr, info_ptr);
+    stream->rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+    stream->out_bytes = stream->width * bg_format_bpp(BG_WIRE_FORMAT);
 
-    png_read_update_info(png_ptr, info_ptr);
+    // libpng keeps its row buffer, packed rows go to one of our own
+    if (BG_WIRE_FORMAT != BG_FORMAT_BGRA8888) {
+        stream->out_row = png_malloc(png_ptr, stream->out_bytes);
+    }
+}
 
-    size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    uint8_t *row = malloc(rowbytes);
-    if (!row) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        return 0;
+static void png_stream_on_row(png_structp png_ptr, png_bytep row, png_uint_32 row_num, int pass) {
+    png_stream_t *stream = png_get_progressive_ptr(png_ptr);
+    if (!row) return;
+
+    if (stream->out_row) {
+        bg_format_pack_row(BG_WIRE_FORMAT, row, stream->out_row, stream->width, row_num);
+        row = stream->out_row;
     }
 
-    uint32_t crc = 0xFFFFFFFF;
+    stream->crc = crc32_update(stream->crc, row, stream->out_bytes);
+    stream->rows++;
+    if (stream->row_cb && !stream->row_cb(row, row_num, stream->out_bytes, stream->arg)) {
+        png_error(png_ptr, "PNG row rejected");
+    }
+}
 
-    for (int y = 0; y < height; y++) {
-        png_read_row(png_ptr, row, NULL);
+static void png_stream_on_end(png_structp png_ptr, png_infop info_ptr) {
+    png_stream_t *stream = png_get_progressive_ptr(png_ptr);
+    stream->done = true;
+}
 
-        // Optional: RGBA → BGRA swap for STM32 compatibility
-        for (int x = 0; x < width; x++) {
-            uint8_t tmp = row[x * 4 + 0];  // R
-            row[x * 4 + 0] = row[x * 4 + 2]; // B
-            row[x * 4 + 2] = tmp;           // R ←→ B
-        }
+/**
+ * @brief Start decoding a PNG that arrives in pieces, e.g. from an HTTP upload.
+ *
+ * Rows are converted to BG_WIRE_FORMAT exactly as decode_png_to_rgba does and
+ * handed to @p row_cb as soon as they are inflated, so no full frame is ever held.
+ *
+ * @param info_cb   Called once with the image size, return false to reject it. May be NULL.
+ * @param row_cb    Called for each decoded row, return false to abort. May be NULL.
+ * @param arg       Passed to both callbacks.
+ *
+ * @return Stream handle, NULL if out of memory.
+ */
+png_stream_t *png_stream_begin(png_stream_info_cb_t info_cb, png_stream_row_cb_t row_cb, void *arg) {
+    png_stream_t *stream = calloc(1, sizeof(png_stream_t));
+    if (!stream) return NULL;
+
+    // The arena is held for the whole upload
+    stream->arena = png_arena_acquire();
+    stream->png_ptr = png_create_arena_read_struct(stream->arena);
+    if (!stream->png_ptr) {
+        png_arena_release(stream->arena);
+        free(stream);
+        return NULL;
+    }
 
-        // Incrementally update CRC32
-        crc = crc32_update(crc, row, rowbytes);
+    stream->info_ptr = png_create_info_struct(stream->png_ptr);
+    if (!stream->info_ptr) {
+        png_destroy_read_struct(&stream->png_ptr, NULL, NULL);
+        png_arena_release(stream->arena);
+        free(stream);
+        return NULL;
     }
 
-    free(row);
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-    return crc;
+    stream->info_cb = info_cb;
+    stream->row_cb = row_cb;
+    stream->arg = arg;
+    stream->crc = CHECKSUM_CRC32_SEED;
+    png_set_progressive_read_fn(stream->png_ptr, stream, png_stream_on_info, png_stream_on_row, png_stream_on_end);
+
+    return stream;
+}
+
+/**
+ * @brief Feed the next piece of PNG data.
+ *
+ * @return false once the data is not a valid PNG or a callback rejected it.
+ */
+bool png_stream_feed(png_stream_t *stream, const uint8_t *data, size_t len) {
+    if (!stream || stream->failed) return false;
+
+    if (setjmp(png_jmpbuf(stream->png_ptr))) {
+        stream->failed = true;
+        return false;
+    }
+
+    png_process_data(stream->png_ptr, stream->info_ptr, (png_bytep)data, len);
+    return true;
+}
+
+/**
+ * @brief Release a stream and report whether the whole image was decoded.
+ *
+ * @param stream    Stream from png_stream_begin, freed by this call.
+ * @param crc       Set to the CRC-32 of all decoded rows, may be NULL.
+ * @param width     Set to the image width, may be NULL.
+ * @param height    Set to the image height, may be NULL.
+ *
+ * @return true if every row of a valid PNG was decoded.
+ */
+bool png_stream_finish(png_stream_t *stream, uint32_t *crc, uint32_t *width, uint32_t *height) {
+    if (!stream) return false;
+
+    bool complete = !stream->failed && stream->done && stream->height > 0 && stream->rows == stream->height;
+    if (complete) {
+        if (crc) *crc = stream->crc;
+        if (width) *width = stream->width;
+        if (height) *height = stream->height;
+    }
+
+    png_free(stream->png_ptr, stream->out_row);
+    png_destroy_read_struct(&stream->png_ptr, &stream->info_ptr, NULL);
+    png_arena_release(stream->arena);
+    free(stream);
+
+    return complete;
 }
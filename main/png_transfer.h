@@ -3,8 +3,20 @@
 
 #include "stdbool.h"
 #include "stdio.h"
+#include "stdint.h"
+#include "stddef.h"
+
+typedef struct png_stream png_stream_t;
+typedef bool (*png_stream_info_cb_t)(uint32_t width, uint32_t height, void *arg);
+typedef bool (*png_stream_row_cb_t)(const uint8_t *row, uint32_t y, uint32_t len, void *arg);
 
 int decode_png_to_rgba(const FILE *fp, uint8_t *buffer, uint32_t buffer_size);
-uint32_t crc32_png_rgba(FILE *fp);
+int decode_png_to_rgba_crc(FILE *fp, uint8_t *buffer, uint32_t buffer_size,
+                           uint32_t *crc, uint32_t *img_width, uint32_t *img_height);
+uint32_t crc32_png_rgba(FILE *fp, uint32_t *width, uint32_t *height);
+
+png_stream_t *png_stream_begin(png_stream_info_cb_t info_cb, png_stream_row_cb_t row_cb, void *arg);
+bool png_stream_feed(png_stream_t *stream, const uint8_t *data, size_t len);
+bool png_stream_finish(png_stream_t *stream, uint32_t *crc, uint32_t *width, uint32_t *height);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "ring_buffer.h"
+
+/**
+ * @brief Attach storage to a ring and reset it.
+ *
+ * @param rb        Ring to initialise.
+ * @param storage   Backing memory, at least @p size bytes.
+ * @param size      Capacity in bytes, must be a power of two.
+ *
+ * @return true on success, false if the arguments are invalid.
+ */
+bool ring_buffer_init(ring_buffer_t *rb, uint8_t *storage, size_t size)
+{
+    if (!rb || !storage || size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+
+    rb->storage = storage;
+    rb->size = size;
+    ring_buffer_reset(rb);
+    return true;
+}
+
+/**
+ * @brief Drop all buffered data. Only safe while neither side is running.
+ */
+void ring_buffer_reset(ring_buffer_t *rb)
+{
+    atomic_store_explicit(&rb->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&rb->tail, 0, memory_order_relaxed);
+}
+
+size_t ring_buffer_used(ring_buffer_t *rb)
+{
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    return head - tail;
+}
+
+/**
+ * @brief Get the largest contiguous free span the producer can fill.
+ *
+ * @param rb    Ring.
+ * @param span  Set to the start of the free span.
+ *
+ * @return Number of bytes that may be written at @p span, 0 if the ring is full.
+ */
+size_t ring_buffer_write_span(ring_buffer_t *rb, uint8_t **span)
+{
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    size_t free_bytes = rb->size - (head - tail);
+    size_t idx = head & (rb->size - 1);
+    size_t to_end = rb->size - idx;
+
+    *span = &rb->storage[idx];
+    return (free_bytes < to_end) ? free_bytes : to_end;
+}
+
+/**
+ * @brief Publish @p len bytes previously written into a write span.
+ */
+void ring_buffer_commit(ring_buffer_t *rb, size_t len)
+{
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    atomic_store_explicit(&rb->head, head + len, memory_order_release);
+}
+
+/**
+ * @brief Get the largest contiguous span of data the consumer can read.
+ *
+ * @param rb    Ring.
+ * @param span  Set to the start of the readable span.
+ *
+ * @return Number of bytes readable at @p span, 0 if the ring is empty.
+ */
+size_t ring_buffer_read_span(ring_buffer_t *rb, const uint8_t **span)
+{
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    size_t avail = head - tail;
+    size_t idx = tail & (rb->size - 1);
+    size_t to_end = rb->size - idx;
+
+    *span = &rb->storage[idx];
+    return (avail < to_end) ? avail : to_end;
+}
+
+/**
+ * @brief Release @p len bytes previously returned by a read span.
+ */
+void ring_buffer_consume(ring_buffer_t *rb, size_t len)
+{
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    atomic_store_explicit(&rb->tail, tail + len, memory_order_release);
+}
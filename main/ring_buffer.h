@@ -0,0 +1,35 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Lock-free single-producer/single-consumer byte ring.
+ *
+ * The producer and consumer each own one index, so no lock is needed as long
+ * as only one task writes and only one task reads. Both sides work on
+ * contiguous spans to avoid per-byte calls.
+ */
+typedef struct {
+    uint8_t *storage;
+    size_t size;            // Must be a power of two
+    atomic_size_t head;     // Advanced by the producer
+    atomic_size_t tail;     // Advanced by the consumer
+} ring_buffer_t;
+
+bool ring_buffer_init(ring_buffer_t *rb, uint8_t *storage, size_t size);
+void ring_buffer_reset(ring_buffer_t *rb);
+size_t ring_buffer_used(ring_buffer_t *rb);
+
+/* Producer side */
+size_t ring_buffer_write_span(ring_buffer_t *rb, uint8_t **span);
+void ring_buffer_commit(ring_buffer_t *rb, size_t len);
+
+/* Consumer side */
+size_t ring_buffer_read_span(ring_buffer_t *rb, const uint8_t **span);
+void ring_buffer_consume(ring_buffer_t *rb, size_t len);
+
+#endif
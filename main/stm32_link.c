@@ -0,0 +1,476 @@
+#include "stm32_link.h"
+#include "stm32_uart.h"
+#include "ke_txn.h"
+#include "ke_sched.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "Link";
+
+#define STM32_LINK_SETTLE_MS    10      // Time for the STM32 to re-arm its UART
+#define STM32_LINK_VERIFY_MS    1000    // Round trip timeout when probing a rate
+#define STM32_LINK_MONITOR_MS   1000    // Error counting window
+#define STM32_LINK_MAX_ERRORS   4       // Frame/parity errors per window before falling back
+#define KE_TICK_US              1000    // KE_tick() period expected by the KE library
+#define KE_TICK_IDLE_MAX_MS     1000    // Ticks replayed after an idle sleep, the rest are skipped
+#define KE_SERVICE_KICK_BIT     (1UL << 1) // Deadlines changed, next to STM32_UART_RX_NOTIFY_BIT
+#define STM32_LINK_HEARTBEAT_MS 5000    // Probe period while the STM32 is not known to be up
+#define STM32_LINK_DOWN_MISSES  2       // Unanswered requests in a row before the STM32 counts as down
+
+// Rates tried in order, anything above CONFIG_ESP32_STM32_UART_MAX_BAUD is skipped
+static const uint32_t link_baud_rates[] = { 3000000, 2000000, 1500000 };
+
+static volatile bool link_escalated = false;
+static volatile bool link_fallback_pending = false;  // Set by the monitor, handled by the heartbeat task
+static int64_t link_monitor_last_us = 0;
+static TaskHandle_t link_heartbeat_task_handle = NULL;
+static TaskHandle_t link_up_notify = NULL;           // Notified when a down link comes back
+static volatile bool link_rate_change = false;       // Probe misses during a baud change are expected
+
+static TaskHandle_t ke_service_task_handle = NULL;
+static SemaphoreHandle_t ke_tick_lock = NULL;        // KE_tick() runs from the service task and waiters
+static int64_t ke_tick_last_us = 0;
+static int64_t ke_wait_deadline_us = 0;              // A KE_wait_for_response() times out here, 0 if none
+
+static portMUX_TYPE link_state_lock = portMUX_INITIALIZER_UNLOCKED;
+static stm32_link_state_t link_state = STM32_LINK_UNKNOWN;
+static int64_t link_last_rx_us = 0;
+static uint32_t link_misses = 0;
+static volatile bool link_heartbeat_enabled = true;
+
+static const char *const link_state_names[] = {
+    [STM32_LINK_UNKNOWN] = "unknown",
+    [STM32_LINK_UP] = "up",
+    [STM32_LINK_DOWN] = "down",
+};
+
+/* Move to a new state, logged once per change */
+static void stm32_link_set_state(stm32_link_state_t state)
+{
+    portENTER_CRITICAL(&link_state_lock);
+    stm32_link_state_t previous = link_state;
+    link_state = state;
+    portEXIT_CRITICAL(&link_state_lock);
+
+    if (previous != state) {
+        ESP_LOGI(TAG, "STM32 link %s -> %s", link_state_names[previous], link_state_names[state]);
+    }
+
+    if (previous == STM32_LINK_DOWN && state == STM32_LINK_UP && !link_rate_change && link_up_notify) {
+        xTaskNotifyGive(link_up_notify);
+    }
+}
+
+/* Something was received, whatever it was the STM32 is there */
+static void stm32_link_note_rx(void)
+{
+    portENTER_CRITICAL(&link_state_lock);
+    link_last_rx_us = esp_timer_get_time();
+    link_misses = 0;
+    portEXIT_CRITICAL(&link_state_lock);
+
+    stm32_link_set_state(STM32_LINK_UP);
+}
+
+stm32_link_state_t stm32_link_get_state(void)
+{
+    portENTER_CRITICAL(&link_state_lock);
+    stm32_link_state_t state = link_state;
+    portEXIT_CRITICAL(&link_state_lock);
+    return state;
+}
+
+/**
+ * @brief Whether a request to the STM32 is worth sending.
+ *
+ * @return false while the link is down. The heartbeat keeps probing and the
+ *         first byte received brings the link back up.
+ */
+bool stm32_link_available(void)
+{
+    return stm32_link_get_state() != STM32_LINK_DOWN;
+}
+
+/**
+ * @brief Time of the last byte received from the STM32, 0 if none yet.
+ */
+int64_t stm32_link_last_rx_us(void)
+{
+    portENTER_CRITICAL(&link_state_lock);
+    int64_t last_rx_us = link_last_rx_us;
+    portEXIT_CRITICAL(&link_state_lock);
+    return last_rx_us;
+}
+
+/**
+ * @brief Record a request the STM32 did not answer in time.
+ *
+ * STM32_LINK_DOWN_MISSES in a row without anything received in between take
+ * the link down.
+ */
+void stm32_link_note_timeout(void)
+{
+    portENTER_CRITICAL(&link_state_lock);
+    bool down = ++link_misses >= STM32_LINK_DOWN_MISSES;
+    portEXIT_CRITICAL(&link_state_lock);
+
+    if (down) {
+        stm32_link_set_state(STM32_LINK_DOWN);
+    }
+}
+
+/**
+ * @brief The STM32 is being reset, forget what is known about the link.
+ *
+ * Requests are let through again until the STM32 is either heard from or
+ * misses enough of them to count as down.
+ */
+void stm32_link_expect_reset(void)
+{
+    portENTER_CRITICAL(&link_state_lock);
+    link_misses = 0;
+    portEXIT_CRITICAL(&link_state_lock);
+
+    stm32_link_set_state(STM32_LINK_UNKNOWN);
+}
+
+/**
+ * @brief Have a task notified each time the link comes back from down.
+ *
+ * Lets work skipped while the STM32 was not answering, like the boot sync,
+ * be queued for when it returns. Transitions caused by a baud change are
+ * not reported.
+ *
+ * @param task  Task to notify with xTaskNotifyGive(), NULL to stop.
+ */
+void stm32_link_set_up_notify(TaskHandle_t task)
+{
+    link_up_notify = task;
+}
+
+/**
+ * @brief Pause the heartbeat while something else owns the STM32.
+ *
+ * Firmware and bootloader flashing turn it off, the bootloaders do not
+ * answer the probe.
+ */
+void stm32_link_set_heartbeat(bool enable)
+{
+    link_heartbeat_enabled = enable;
+}
+
+/* Have the service task work out its next deadline again */
+static void ke_service_kick(void)
+{
+    if (ke_service_task_handle) {
+        xTaskNotify(ke_service_task_handle, KE_SERVICE_KICK_BIT, eSetBits);
+    }
+}
+
+/* Round trip an option list request and check it came back clean */
+static bool stm32_link_verify(void)
+{
+    stm32_uart_take_error_count();
+
+    uint32_t txn = ke_txn_begin(KE_TXN_OPTION_LIST, 0);
+    bool answered = ke_txn_wait(txn, STM32_LINK_VERIFY_MS, NULL);
+
+    return answered && stm32_uart_take_error_count() == 0;
+}
+
+/* Announce a rate with the sync character and verify it with a round trip */
+static bool stm32_link_try_baud(uint32_t baud)
+{
+    if (stm32_uart_set_baud(baud) != ESP_OK) {
+        return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(STM32_LINK_SETTLE_MS));
+
+    return stm32_link_verify();
+}
+
+/**
+ * @brief Move the KE link to the fastest rate both sides can sustain.
+ *
+ * Each candidate rate is announced with the STM32 auto baud sync character
+ * and then verified with a full request/response round trip. If no rate
+ * verifies the link stays at STM32_UART_BASE_BAUD.
+ *
+ * @return true if the link is now running above the base rate.
+ */
+bool stm32_link_negotiate_baud(void)
+{
+    bool escalated = false;
+
+    link_rate_change = true;
+    for (size_t i = 0; i < sizeof(link_baud_rates) / sizeof(link_baud_rates[0]); i++) {
+        uint32_t baud = link_baud_rates[i];
+        if (baud > CONFIG_ESP32_STM32_UART_MAX_BAUD) {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Trying KE link at %lu baud", (unsigned long)baud);
+        if (stm32_link_try_baud(baud)) {
+            ESP_LOGI(TAG, "KE link running at %lu baud", (unsigned long)baud);
+            link_monitor_last_us = esp_timer_get_time();
+            link_escalated = true;
+            escalated = true;
+            // The service task may be asleep with no deadline, the monitor window is one now
+            ke_service_kick();
+            break;
+        }
+
+        ESP_LOGW(TAG, "STM32 did not answer cleanly at %lu baud", (unsigned long)baud);
+    }
+
+    if (!escalated && stm32_uart_get_baud() != STM32_UART_BASE_BAUD) {
+        // A garbled probe may have left a bad option list, the verify fetches it again at the safe rate
+        stm32_link_try_baud(STM32_UART_BASE_BAUD);
+    }
+    link_rate_change = false;
+
+    return escalated;
+}
+
+/*
+ * Line errors rose at the negotiated rate, move both sides back to the base
+ * rate the same way negotiation moved them up. If the STM32 does not follow,
+ * return to the previous rate rather than leave the two ends apart.
+ */
+static void stm32_link_fall_back(void)
+{
+    uint32_t previous = stm32_uart_get_baud();
+
+    link_rate_change = true;
+    ESP_LOGW(TAG, "Falling back from %lu to %d baud", (unsigned long)previous, STM32_UART_BASE_BAUD);
+    if (stm32_link_try_baud(STM32_UART_BASE_BAUD)) {
+        link_escalated = false;
+    } else {
+        ESP_LOGW(TAG, "STM32 did not follow the fallback, restoring %lu baud", (unsigned long)previous);
+        if (stm32_link_try_baud(previous)) {
+            link_monitor_last_us = esp_timer_get_time();
+            ke_service_kick();
+        } else {
+            // Neither rate answers, the link state takes over and the heartbeat keeps probing at this rate
+            ESP_LOGE(TAG, "STM32 not answering at %lu baud either", (unsigned long)previous);
+            link_escalated = false;
+        }
+    }
+    link_rate_change = false;
+}
+
+/*
+ * Probe the STM32 until it is heard from. Once it is up the probe stops, each
+ * one costs the STM32 a checksum over a full background; a link that drops
+ * while idle is noticed by the next request instead.
+ */
+static void stm32_link_heartbeat_task(void *pvParameters)
+{
+    while (1) {
+        // Woken early by the link monitor when a baud fallback is due
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STM32_LINK_HEARTBEAT_MS));
+
+        // Paused while a bootloader owns the STM32, a pending fallback waits for it too
+        if (!link_heartbeat_enabled) {
+            continue;
+        }
+
+        if (link_fallback_pending) {
+            stm32_link_fall_back();
+            link_fallback_pending = false;
+            continue;
+        }
+
+        if (stm32_link_get_state() == STM32_LINK_UP) {
+            continue;
+        }
+
+        // A background CRC query is the smallest request the STM32 answers
+        ke_txn_wait(ke_txn_begin(KE_TXN_BACKGROUND_CRC, 0), STM32_LINK_VERIFY_MS, NULL);
+    }
+}
+
+/**
+ * @brief Watch line errors and request a fallback to the base rate when they rise.
+ *
+ * Called from the KE service task; the error count is evaluated once per
+ * monitor window. The fallback itself waits on round trips, so it runs on
+ * the heartbeat task and KE_Service() keeps going meanwhile. After a
+ * fallback the link stays at the base rate until the next negotiation.
+ */
+static void stm32_link_monitor(void)
+{
+    if (!link_escalated || link_fallback_pending) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (now - link_monitor_last_us < STM32_LINK_MONITOR_MS * 1000LL) {
+        return;
+    }
+    link_monitor_last_us = now;
+
+    uint32_t errors = stm32_uart_take_error_count();
+    if (errors > STM32_LINK_MAX_ERRORS) {
+        ESP_LOGW(TAG, "%lu line errors at %lu baud", (unsigned long)errors, (unsigned long)stm32_uart_get_baud());
+        link_fallback_pending = true;
+        if (link_heartbeat_task_handle) {
+            xTaskNotifyGive(link_heartbeat_task_handle);
+        }
+    }
+}
+
+/* Advance the KE millisecond clock to real time, however long we slept. Caller holds ke_tick_lock */
+static void ke_tick_catch_up(int64_t now)
+{
+    // After hours asleep nothing is timing out against the KE clock. A second is still replayed
+    // so a partial frame in the KE parser times out, replaying every tick would stall the task
+    if (ke_wait_deadline_us == 0 && now - ke_tick_last_us > KE_TICK_IDLE_MAX_MS * 1000LL) {
+        ke_tick_last_us = now - KE_TICK_IDLE_MAX_MS * 1000LL;
+    }
+
+    while (now - ke_tick_last_us >= KE_TICK_US) {
+        KE_tick();
+        ke_tick_last_us += KE_TICK_US;
+    }
+}
+
+/**
+ * @brief Announce a KE_wait_for_response() of @p timeout_ms.
+ *
+ * The KE clock only moves when the service task wakes, and with nothing
+ * pending it sleeps until the STM32 sends something. The clock is brought
+ * up to date here so the wait starts from the current time, and the service
+ * task is told to wake by the timeout so the wait can expire.
+ *
+ * Call right before KE_wait_for_response() and stm32_link_wait_end() after.
+ */
+void stm32_link_wait_begin(uint32_t timeout_ms)
+{
+    if (!ke_tick_lock) {
+        return;
+    }
+
+    xSemaphoreTake(ke_tick_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    ke_tick_catch_up(now);
+    ke_wait_deadline_us = now + timeout_ms * 1000LL;
+    xSemaphoreGive(ke_tick_lock);
+
+    ke_service_kick();
+}
+
+/**
+ * @brief The KE_wait_for_response() announced with stm32_link_wait_begin() returned.
+ */
+void stm32_link_wait_end(void)
+{
+    if (!ke_tick_lock) {
+        return;
+    }
+
+    xSemaphoreTake(ke_tick_lock, portMAX_DELAY);
+    ke_wait_deadline_us = 0;
+    xSemaphoreGive(ke_tick_lock);
+}
+
+/* Time until the next thing the service task has to do without being woken */
+static TickType_t ke_service_wait_ticks(int64_t now)
+{
+    int64_t deadline = INT64_MAX;
+
+    xSemaphoreTake(ke_tick_lock, portMAX_DELAY);
+    if (ke_wait_deadline_us != 0 && ke_wait_deadline_us <= ke_tick_last_us) {
+        // The KE clock has passed the timeout, the waiter sees it without us
+        ke_wait_deadline_us = 0;
+    }
+    if (ke_wait_deadline_us != 0) {
+        deadline = ke_wait_deadline_us;
+    }
+    xSemaphoreGive(ke_tick_lock);
+
+    if (link_escalated && !link_fallback_pending) {
+        int64_t monitor_deadline = link_monitor_last_us + STM32_LINK_MONITOR_MS * 1000LL;
+        if (monitor_deadline < deadline) {
+            deadline = monitor_deadline;
+        }
+    }
+
+    if (deadline == INT64_MAX) {
+        return portMAX_DELAY;
+    }
+    if (deadline <= now) {
+        return 0;
+    }
+
+    // Round up so we never wake before the deadline and spin
+    return (TickType_t)((deadline - now + portTICK_PERIOD_MS * 1000LL - 1) / (portTICK_PERIOD_MS * 1000LL));
+}
+
+void ke_service_task(void *pvParameters)
+{
+    PKE_PACKET_MANAGER dev = (PKE_PACKET_MANAGER)pvParameters;
+
+    while (1) {
+        // Woken by the UART parse task as soon as RX bytes have been parsed, or by a new deadline
+        uint32_t events = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &events, ke_service_wait_ticks(esp_timer_get_time()));
+        if (events & STM32_UART_RX_NOTIFY_BIT) {
+            stm32_link_note_rx();
+        }
+
+        xSemaphoreTake(ke_tick_lock, portMAX_DELAY);
+        ke_tick_catch_up(esp_timer_get_time());
+        xSemaphoreGive(ke_tick_lock);
+
+        // Replies are built in tx_buffer, wait out a request frame being sent from it
+        ke_sched_tx_lock();
+        KE_Service(dev);
+        ke_sched_tx_unlock();
+        stm32_link_monitor();
+    }
+}
+
+/**
+ * @brief Start the KE service task.
+ *
+ * The task runs KE_Service() whenever the UART has parsed new bytes and keeps
+ * the KE clock and link monitor running from deadlines, so no periodic timer
+ * or polling loop is needed. With no KE_wait_for_response() timeout and no
+ * monitor window pending it sleeps until the STM32 sends something.
+ * A low priority heartbeat task probes the STM32 every STM32_LINK_HEARTBEAT_MS
+ * while it is not known to be up, so a down link comes back, and carries out
+ * baud fallbacks requested by the link monitor.
+ *
+ * @param dev   KE packet manager for the STM32 link.
+ */
+void stm32_link_start(PKE_PACKET_MANAGER dev)
+{
+    if (ke_service_task_handle) {
+        return;
+    }
+
+    ke_tick_lock = xSemaphoreCreateMutex();
+    ke_tick_last_us = esp_timer_get_time();
+
+    BaseType_t task_ok = xTaskCreate(ke_service_task,
+                                     "ke_service_task",         // name
+                                     8192,                      // stack size
+                                     dev,                       // param
+                                     10,                        // priority
+                                     &ke_service_task_handle);  // out handle
+    if (task_ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create KE service task");
+        return;
+    }
+
+    stm32_uart_set_rx_notify(ke_service_task_handle);
+
+    if (xTaskCreate(stm32_link_heartbeat_task, "link_heartbeat", 3072, NULL, 2, &link_heartbeat_task_handle) != pdPASS) {
+        ESP_LOGW(TAG, "No heartbeat task, an idle STM32 dropping out goes unnoticed");
+    }
+}
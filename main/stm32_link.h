@@ -0,0 +1,29 @@
+#ifndef STM32_LINK_H
+#define STM32_LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lib_ke_protocol.h"
+
+// Whether the STM32 is answering, judged from RX activity and unanswered requests
+typedef enum {
+    STM32_LINK_UNKNOWN,     // Nothing heard since boot or an expected reset
+    STM32_LINK_UP,          // The STM32 sent something recently
+    STM32_LINK_DOWN,        // Requests go unanswered, callers should fail fast
+} stm32_link_state_t;
+
+void stm32_link_start(PKE_PACKET_MANAGER dev);
+bool stm32_link_negotiate_baud(void);
+stm32_link_state_t stm32_link_get_state(void);
+bool stm32_link_available(void);
+int64_t stm32_link_last_rx_us(void);
+void stm32_link_note_timeout(void);
+void stm32_link_wait_begin(uint32_t timeout_ms);
+void stm32_link_wait_end(void);
+void stm32_link_expect_reset(void);
+void stm32_link_set_heartbeat(bool enable);
+void stm32_link_set_up_notify(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,189 @@
+#include "stm32_lz4.h"
+#include <string.h>
+
+/*
+ * KE frames are wrapped for a link that compresses ESP32 -> STM32 traffic:
+ *
+ *   u8  STM32_LZ4_MAGIC
+ *   u32 raw frame length, little endian
+ *   blocks, each STM32_LZ4_BLOCK_SIZE raw bytes except the last:
+ *     u16 header, little endian: payload length, STM32_LZ4_STORED if raw
+ *     payload, an LZ4 block (no frame format) or the raw bytes
+ *
+ * Blocks are independent, so the STM32 needs one block of output and no
+ * history to unpack a frame as it arrives.
+ */
+
+#define LZ4_MIN_MATCH     4
+#define LZ4_LAST_LITERALS 5   // The block format ends in at least this many literals
+#define LZ4_MF_LIMIT      12  // No match may start closer than this to the end
+#define LZ4_HASH_BITS     12
+#define LZ4_HEADER_SIZE   5
+#define LZ4_BLOCK_HEADER  2
+
+// Positions within the current block, blocks are small enough for 16 bits.
+// Shared by every call, stm32_lz4_pack() callers must be serialised.
+static uint16_t lz4_table[1 << LZ4_HASH_BITS];
+
+static inline uint32_t lz4_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz4_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Length continuation bytes after a saturated token nibble */
+static uint8_t *lz4_put_length(uint8_t *op, uint32_t len)
+{
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/**
+ * @brief Greedy LZ4 block compression of one block.
+ *
+ * @return Compressed size, 0 if it does not fit in @p cap.
+ */
+static uint32_t lz4_compress_block(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + cap;
+
+    memset(lz4_table, 0, sizeof(lz4_table));
+
+    if (len > LZ4_MF_LIMIT) {
+        const uint8_t *mf_limit = end - LZ4_MF_LIMIT;
+        const uint8_t *match_limit = end - LZ4_LAST_LITERALS;
+
+        lz4_table[lz4_hash(lz4_read32(ip))] = 0;
+        ip++;
+
+        while (ip <= mf_limit) {
+            uint32_t h = lz4_hash(lz4_read32(ip));
+            const uint8_t *ref = src + lz4_table[h];
+            lz4_table[h] = (uint16_t)(ip - src);
+
+            if (ref >= ip || lz4_read32(ref) != lz4_read32(ip)) {
+                // Skip faster through data that does not compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t *mp = ip + LZ4_MIN_MATCH;
+            const uint8_t *rp = ref + LZ4_MIN_MATCH;
+            while (mp < match_limit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            uint32_t lit = ip - anchor;
+            uint32_t match = mp - ip - LZ4_MIN_MATCH;
+            if ((uint32_t)(op_end - op) < 1 + lit + lit / 255 + 1 + 2 + match / 255 + 1) {
+                return 0;
+            }
+
+            uint8_t *token = op++;
+            *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+            if (lit >= 15) {
+                op = lz4_put_length(op, lit - 15);
+            }
+            memcpy(op, anchor, lit);
+            op += lit;
+
+            uint16_t offset = (uint16_t)(ip - ref);
+            *op++ = offset & 0xFF;
+            *op++ = offset >> 8;
+
+            *token |= (match >= 15) ? 15 : match;
+            if (match >= 15) {
+                op = lz4_put_length(op, match - 15);
+            }
+
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    uint32_t lit = end - anchor;
+    if ((uint32_t)(op_end - op) < 1 + lit + lit / 255 + 1) {
+        return 0;
+    }
+    *op++ = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) {
+        op = lz4_put_length(op, lit - 15);
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return op - dst;
+}
+
+/**
+ * @brief Largest packed size of a @p len byte frame.
+ */
+uint32_t stm32_lz4_bound(uint32_t len)
+{
+    uint32_t blocks = (len + STM32_LZ4_BLOCK_SIZE - 1) / STM32_LZ4_BLOCK_SIZE;
+    return LZ4_HEADER_SIZE + len + blocks * LZ4_BLOCK_HEADER;
+}
+
+/**
+ * @brief Wrap a KE frame in the compressed link format.
+ *
+ * Blocks that do not shrink are stored, so the result never exceeds
+ * stm32_lz4_bound(). Not reentrant, the hash table is static to keep it
+ * off the small task stacks; stm32_tx() only runs under ke_sched_tx_lock().
+ *
+ * @return Packed length, 0 if @p out_size is too small.
+ */
+uint32_t stm32_lz4_pack(const uint8_t *frame, uint32_t len, uint8_t *out, uint32_t out_size)
+{
+    if (out_size < stm32_lz4_bound(len)) {
+        return 0;
+    }
+
+    uint8_t *op = out;
+    *op++ = STM32_LZ4_MAGIC;
+    *op++ = len & 0xFF;
+    *op++ = (len >> 8) & 0xFF;
+    *op++ = (len >> 16) & 0xFF;
+    *op++ = len >> 24;
+
+    for (uint32_t ofs = 0; ofs < len; ofs += STM32_LZ4_BLOCK_SIZE) {
+        uint32_t raw = (len - ofs < STM32_LZ4_BLOCK_SIZE) ? len - ofs : STM32_LZ4_BLOCK_SIZE;
+        uint8_t *header = op;
+        op += LZ4_BLOCK_HEADER;
+
+        // Anything not smaller than the raw block is sent as it is
+        uint16_t block_header;
+        uint32_t packed = lz4_compress_block(frame + ofs, raw, op, raw - 1);
+        if (packed > 0) {
+            block_header = (uint16_t)packed;
+        } else {
+            memcpy(op, frame + ofs, raw);
+            packed = raw;
+            block_header = (uint16_t)raw | STM32_LZ4_STORED;
+        }
+        header[0] = block_header & 0xFF;
+        header[1] = block_header >> 8;
+        op += packed;
+    }
+
+    return op - out;
+}
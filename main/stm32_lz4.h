@@ -0,0 +1,13 @@
+#ifndef STM32_LZ4_H
+#define STM32_LZ4_H
+
+#include <stdint.h>
+
+#define STM32_LZ4_MAGIC       0x5A  // First byte of every compressed KE frame
+#define STM32_LZ4_BLOCK_SIZE  4096  // Raw bytes per block, the STM32 decodes one block at a time
+#define STM32_LZ4_STORED      0x8000 // Block header flag, the block is sent uncompressed
+
+uint32_t stm32_lz4_bound(uint32_t len);
+uint32_t stm32_lz4_pack(const uint8_t *frame, uint32_t len, uint8_t *out, uint32_t out_size);
+
+#endif
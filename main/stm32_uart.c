@@ -1,34 +1,173 @@
 #include "stm32_uart.h"
+#include "ring_buffer.h"
 #include "driver/uart.h"
+#include "driver/gpio.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
+#include <sys/param.h>
+#include <stdatomic.h>
 
 #define DEBUG_UART_RX 0
 
+#define STM32_TX_MAX_CHUNK_SIZE    0x7FFF // 1/2 0xFFFF which is the STM32 max DMA size
+#define STM32_TX_CHUNK_DELAY_TICKS 25     // Legacy wait after each chunk
+#define STM32_UART_SYNC_CHAR       0x7F   // STM32 USART auto baud rate detection pattern
+#define STM32_TX_MAX_CREDITS       4      // Receiver-ready edges we remember
+#define STM32_TX_CREDIT_PROBE_MS   1000   // First wait, decides if the STM32 supports it
+#define STM32_TX_CREDIT_TIMEOUT_MS 5000   // Later waits, STM32 may be busy writing flash
+#define STM32_TX_IDLE_BIT          BIT0   // No async frame queued or in flight
+
+#ifdef CONFIG_ESP32_STM32_UART_HW_FLOWCTRL
+#define STM32_UART_FLOW_CTRL   UART_HW_FLOWCTRL_CTS_RTS
+#define STM32_UART_RTS_PIN     CONFIG_STM32_CTS_ESP32_RTS
+#define STM32_UART_CTS_PIN     CONFIG_STM32_RTS_ESP32_CTS
+#else
+#define STM32_UART_FLOW_CTRL   UART_HW_FLOWCTRL_DISABLE
+#define STM32_UART_RTS_PIN     UART_PIN_NO_CHANGE
+#define STM32_UART_CTS_PIN     UART_PIN_NO_CHANGE
+#endif
+#define STM32_UART_RTS_THRESH  (UART_HW_FIFO_LEN(CONFIG_ESP32_STM32_UART_CONTROLLER) - 8)
+
+// Receiver-ready credits are only used when RTS/CTS is not available
+#if !defined(CONFIG_ESP32_STM32_UART_HW_FLOWCTRL) && CONFIG_STM32_READY_PIN >= 0
+#define STM32_UART_READY_CREDITS 1
+#else
+#define STM32_UART_READY_CREDITS 0
+#endif
+
 static const char *TAG = "UART";
 static QueueHandle_t uart_event_queue;
 static bool uart_initialized = false;
 static TaskHandle_t uart_task_handle = NULL;
+static TaskHandle_t uart_parse_task_handle = NULL;
+static TaskHandle_t uart_rx_notify_task = NULL;
+static SemaphoreHandle_t uart_tx_lock = NULL;
+static uint32_t uart_baud = STM32_UART_BASE_BAUD;
+static atomic_uint uart_line_errors = 0;
 
-void uart_event_task(void *pvParameters)
+// Async TX: one frame at a time, streamed straight from the caller's buffer
+typedef struct {
+    const uint8_t *data;
+    uint32_t len;
+    stm32_uart_tx_done_cb_t done_cb;
+    void *arg;
+} uart_tx_job_t;
+
+static TaskHandle_t uart_tx_task_handle = NULL;
+static QueueHandle_t uart_tx_queue = NULL;
+static EventGroupHandle_t uart_tx_events = NULL;
+
+// Bytes read from the UART driver, waiting to be fed to the KE parser
+static uint8_t rx_ring_storage[CONFIG_ESP32_STM32_UART_RX_RING_SIZE];
+static ring_buffer_t rx_ring;
+
+#if STM32_UART_READY_CREDITS
+// One credit per rising edge of the STM32 RX ready line
+static SemaphoreHandle_t tx_credits = NULL;
+static bool tx_credit_mode = false;
+static bool tx_credit_seen = false;
+#endif
+
+/**
+ * @brief Feed a span of received bytes to the KE parser.
+ *
+ * Batch entry point for the RX path: callers hand over whole spans rather
+ * than single bytes so the UART driver is only touched once per event.
+ *
+ * @param dev   KE packet manager receiving the bytes.
+ * @param data  Received bytes.
+ * @param len   Number of bytes in @p data.
+ */
+void stm32_uart_ingest(PKE_PACKET_MANAGER dev, const uint8_t *data, size_t len)
 {
-    uart_event_t event;
-    uint8_t rx_data;
+    for (size_t i = 0; i < len; i++) {
+        KE_Add_UART_Byte(dev, data[i]);
+#if DEBUG_UART_RX
+        ESP_LOGI(TAG, "RX Char: %c", data[i]);
+#endif
+    }
+}
 
+/**
+ * @brief Register a task to be notified after each batch of RX bytes is parsed.
+ *
+ * The task's notification value gets STM32_UART_RX_NOTIFY_BIT set, so it can
+ * wait with xTaskNotifyWait() for other notifications too.
+ *
+ * @param task  Task to notify, NULL to stop notifying.
+ */
+void stm32_uart_set_rx_notify(TaskHandle_t task)
+{
+    uart_rx_notify_task = task;
+}
+
+/* Move everything the driver has buffered into the RX ring */
+static void uart_drain_to_ring(void)
+{
+    size_t pending = 0;
+    uart_get_buffered_data_len(CONFIG_ESP32_STM32_UART_CONTROLLER, &pending);
+
+    while (pending > 0) {
+        uint8_t *span;
+        size_t room = ring_buffer_write_span(&rx_ring, &span);
+        if (room == 0) {
+            // Parser is behind, let it catch up before reading more
+            xTaskNotifyGive(uart_parse_task_handle);
+            vTaskDelay(1);
+            continue;
+        }
+
+        int len = uart_read_bytes(CONFIG_ESP32_STM32_UART_CONTROLLER, span, MIN(room, pending), 0);
+        if (len <= 0) {
+            break;
+        }
+
+        ring_buffer_commit(&rx_ring, len);
+        pending -= len;
+    }
+}
+
+void uart_parse_task(void *pvParameters)
+{
     PKE_PACKET_MANAGER dev = (PKE_PACKET_MANAGER)pvParameters;
 
+    while (1) {
+        // Woken by the RX task whenever new bytes land in the ring
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        const uint8_t *span;
+        size_t len;
+        bool ingested = false;
+        while ((len = ring_buffer_read_span(&rx_ring, &span)) > 0) {
+            stm32_uart_ingest(dev, span, len);
+            ring_buffer_consume(&rx_ring, len);
+            ingested = true;
+        }
+
+        // Let the KE service task handle whatever the parser just completed
+        if (ingested && uart_rx_notify_task) {
+            xTaskNotify(uart_rx_notify_task, STM32_UART_RX_NOTIFY_BIT, eSetBits);
+        }
+
+    }
+}
+
+void uart_event_task(void *pvParameters)
+{
+    uart_event_t event;
+
     while (1) {
         // Wait for UART event from ISR
         if (xQueueReceive(uart_event_queue, &event, portMAX_DELAY)) {
             switch (event.type) {
                 case UART_DATA:
-                    // DMA has received some bytes — process them one at a time
-                    while (uart_read_bytes(CONFIG_ESP32_STM32_UART_CONTROLLER, &rx_data, 1, 0) > 0) {
-                        KE_Add_UART_Byte(dev, rx_data);
-#if DEBUG_UART_RX
-                        ESP_LOGI(TAG, "RX Char: %c", rx_data);
-#endif
-                    }
+                {
+                    // DMA has received some bytes — move them all in one read
+                    uart_drain_to_ring();
+                    xTaskNotifyGive(uart_parse_task_handle);
                     break;
+                }
 
                 case UART_FIFO_OVF:
                     ESP_LOGW(TAG, "UART FIFO Overflow");
@@ -49,6 +188,7 @@ void uart_event_task(void *pvParameters)
                 case UART_PARITY_ERR:
                 case UART_FRAME_ERR:
                     ESP_LOGE(TAG, "UART Frame/Parity Error");
+                    atomic_fetch_add(&uart_line_errors, 1);
                     break;
 
                 default:
@@ -58,36 +198,373 @@ void uart_event_task(void *pvParameters)
     }
 }
 
-void uart_init(PKE_PACKET_MANAGER dev_ptr)
+#if STM32_UART_READY_CREDITS
+static void IRAM_ATTR stm32_ready_isr(void *arg)
 {
-    if (uart_initialized) {
-        ESP_LOGI(TAG, "UART already initialized. Deinitializing first.");
-        // Delete task if already running
-        if (uart_task_handle) {
-            vTaskDelete(uart_task_handle);
-            uart_task_handle = NULL;
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(tx_credits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+#endif
+
+/* Set up TX flow control towards the STM32: RTS/CTS, RX ready line or none */
+static void stm32_flow_init(void)
+{
+#if defined(CONFIG_ESP32_STM32_UART_HW_FLOWCTRL)
+    ESP_LOGI(TAG, "STM32 RTS/CTS flow control on CTS GPIO%d, RTS GPIO%d",
+             STM32_UART_CTS_PIN, STM32_UART_RTS_PIN);
+#elif STM32_UART_READY_CREDITS
+    if (!tx_credits) {
+        tx_credits = xSemaphoreCreateCounting(STM32_TX_MAX_CREDITS, 0);
+        if (!tx_credits) {
+            ESP_LOGE(TAG, "Failed to create TX credit semaphore");
+            return;
         }
 
-        // Delete UART driver
-        uart_driver_delete(CONFIG_ESP32_STM32_UART_CONTROLLER);
-        uart_event_queue = NULL;
-        uart_initialized = false;
+        gpio_config_t io_conf = {
+            .pin_bit_mask = (1ULL << CONFIG_STM32_READY_PIN),
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = GPIO_PULLUP_DISABLE,
+            .pull_down_en = GPIO_PULLDOWN_ENABLE,
+            .intr_type = GPIO_INTR_POSEDGE
+        };
+        gpio_config(&io_conf);
+
+        // The ISR service may already be installed by another driver
+        esp_err_t err = gpio_install_isr_service(0);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            ESP_LOGE(TAG, "Failed to install GPIO ISR service (%s)", esp_err_to_name(err));
+            return;
+        }
+        gpio_isr_handler_add(CONFIG_STM32_READY_PIN, stm32_ready_isr, NULL);
+    }
+
+    // Drop stale credits, a high line means the STM32 has room right now
+    while (xSemaphoreTake(tx_credits, 0) == pdTRUE) {}
+    if (gpio_get_level(CONFIG_STM32_READY_PIN)) {
+        xSemaphoreGive(tx_credits);
+    }
+
+    tx_credit_mode = true;
+    tx_credit_seen = false;
+    ESP_LOGI(TAG, "STM32 RX ready flow control on GPIO%d", CONFIG_STM32_READY_PIN);
+#endif
+}
+
+/**
+ * @brief Block until the STM32 can accept another TX chunk.
+ *
+ * With an RX ready line configured this consumes one receiver-ready credit.
+ * If the STM32 never signals ready it is assumed to run firmware without
+ * support and the link falls back to the fixed delay in stm32_uart_tx_chunk_sent().
+ */
+static void stm32_uart_wait_tx_ready(void)
+{
+#if STM32_UART_READY_CREDITS
+    if (!tx_credits) {
+        return;
+    }
+
+    if (!tx_credit_mode) {
+        // A late edge means the STM32 came up with support after all
+        if (xSemaphoreTake(tx_credits, 0) == pdTRUE) {
+            ESP_LOGI(TAG, "STM32 RX ready signal detected, leaving fixed TX delay mode");
+            tx_credit_mode = true;
+            tx_credit_seen = true;
+        }
+        return;
+    }
+
+    uint32_t timeout_ms = tx_credit_seen ? STM32_TX_CREDIT_TIMEOUT_MS : STM32_TX_CREDIT_PROBE_MS;
+    if (xSemaphoreTake(tx_credits, pdMS_TO_TICKS(timeout_ms)) == pdTRUE) {
+        tx_credit_seen = true;
+        return;
+    }
+
+    if (!tx_credit_seen) {
+        ESP_LOGW(TAG, "No RX ready signal from STM32, falling back to fixed TX delay");
+        tx_credit_mode = false;
+    } else {
+        ESP_LOGW(TAG, "Timed out waiting for STM32 RX ready, sending anyway");
+    }
+#endif
+}
+
+/**
+ * @brief Called after each TX chunk has been queued to the UART.
+ *
+ * Without receiver-ready credits the STM32 gives no signal when its DMA
+ * buffer is free again, so the only option is to wait a fixed time.
+ */
+static void stm32_uart_tx_chunk_sent(void)
+{
+#if defined(CONFIG_ESP32_STM32_UART_HW_FLOWCTRL)
+    // CTS already holds the TX back while the STM32 is busy
+    return;
+#else
+#if STM32_UART_READY_CREDITS
+    if (tx_credit_mode) {
+        return;
+    }
+#endif
+
+    // Wait for the reciever to process data. THIS IS A MUST
+    vTaskDelay(STM32_TX_CHUNK_DELAY_TICKS);
+#endif
+}
+
+/* Push a frame out in STM32 sized chunks, caller must hold uart_tx_lock. @p stop may be NULL */
+static size_t uart_tx_stream(const uint8_t *data, uint32_t len, stm32_uart_tx_stop_cb_t stop)
+{
+    size_t total_sent = 0;
+
+    while (total_sent < len) {
+        // Asked between chunks only, the STM32 DMA takes whole chunks
+        if (total_sent > 0 && stop && stop()) {
+            break;
+        }
+
+        size_t chunk = len - total_sent;
+        chunk = ( chunk > STM32_TX_MAX_CHUNK_SIZE ) ? (STM32_TX_MAX_CHUNK_SIZE) : chunk;
+
+        // Block until the STM32 DMA buffer has room for this chunk
+        stm32_uart_wait_tx_ready();
+
+        // The driver has no TX ring, bytes go from data straight into the FIFO
+        int sent = uart_write_bytes(CONFIG_ESP32_STM32_UART_CONTROLLER,
+                                    (const char *)(data + total_sent),
+                                    chunk);
+
+        if (sent < 0) {
+            ESP_LOGE(TAG, "TX failed at byte %u", total_sent);
+            break;  // Return bytes sent before error
+        }
+
+        // Legacy STM32 firmware needs a fixed delay to process the chunk
+        stm32_uart_tx_chunk_sent();
+
+        total_sent += sent;
+    }
+
+
+    return total_sent;
+}
+
+void uart_tx_task(void *pvParameters)
+{
+    uart_tx_job_t job;
+
+    while (1) {
+        if (xQueueReceive(uart_tx_queue, &job, portMAX_DELAY)) {
+            xSemaphoreTake(uart_tx_lock, portMAX_DELAY);
+            size_t sent = uart_tx_stream(job.data, job.len, NULL);
+            // Make sure the last byte has left before the buffer is handed back
+            uart_wait_tx_done(CONFIG_ESP32_STM32_UART_CONTROLLER, portMAX_DELAY);
+            xSemaphoreGive(uart_tx_lock);
+
+            xEventGroupSetBits(uart_tx_events, STM32_TX_IDLE_BIT);
+            if (job.done_cb) {
+                job.done_cb((int)sent, job.arg);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Wait for an async frame queued with stm32_uart_write_async() to finish.
+ *
+ * @param timeout_ms    Maximum time to wait, portMAX_DELAY waits forever.
+ *
+ * @return true if no async frame is in flight.
+ */
+bool stm32_uart_tx_wait_done(uint32_t timeout_ms)
+{
+    if (!uart_tx_events) {
+        return true;
+    }
+
+    TickType_t ticks = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    EventBits_t bits = xEventGroupWaitBits(uart_tx_events, STM32_TX_IDLE_BIT, pdFALSE, pdTRUE, ticks);
+    return (bits & STM32_TX_IDLE_BIT) != 0;
+}
+
+/**
+ * @brief Queue a KE frame to be sent by the UART TX task.
+ *
+ * Returns as soon as the frame is queued. The bytes are read straight from
+ * @p data while they are sent, so the buffer must stay untouched until
+ * @p done_cb runs or stm32_uart_tx_wait_done() returns true. Only one frame
+ * can be in flight, a second call waits for the first to finish.
+ *
+ * @param data      Bytes to send.
+ * @param len       Number of bytes in @p data.
+ * @param done_cb   Called from the TX task with the number of bytes sent, may be NULL.
+ * @param arg       Passed to @p done_cb.
+ *
+ * @return ESP_OK if queued, ESP_ERR_INVALID_STATE if the UART is not running.
+ */
+esp_err_t stm32_uart_write_async(const uint8_t *data, uint32_t len, stm32_uart_tx_done_cb_t done_cb, void *arg)
+{
+    if (!uart_tx_task_handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xEventGroupWaitBits(uart_tx_events, STM32_TX_IDLE_BIT, pdTRUE, pdTRUE, portMAX_DELAY);
+
+    uart_tx_job_t job = {
+        .data = data,
+        .len = len,
+        .done_cb = done_cb,
+        .arg = arg
+    };
+    xQueueSend(uart_tx_queue, &job, portMAX_DELAY);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Send a KE frame to the STM32.
+ *
+ * The frame is split into chunks no larger than the STM32 DMA size and each
+ * chunk is paced by the configured flow control. Concurrent callers and baud
+ * rate changes are serialised so frames are never interleaved.
+ *
+ * @param data  Bytes to send.
+ * @param len   Number of bytes in @p data.
+ *
+ * @return Number of bytes sent.
+ */
+int stm32_uart_write(const uint8_t *data, uint32_t len)
+{
+    return stm32_uart_write_preemptible(data, len, NULL);
+}
+
+/**
+ * @brief Send a KE frame to the STM32, giving up between chunks when asked.
+ *
+ * Same as stm32_uart_write(), but @p stop is called before every chunk after
+ * the first. Once it returns true the rest of the frame is dropped, and the
+ * call returns when the chunks already written have left the wire so the
+ * caller can time the idle gap that ends the frame on the STM32.
+ *
+ * @param data  Bytes to send.
+ * @param len   Number of bytes in @p data.
+ * @param stop  Polled between chunks, NULL sends the whole frame.
+ *
+ * @return Number of bytes sent, less than @p len if @p stop cut the frame.
+ */
+int stm32_uart_write_preemptible(const uint8_t *data, uint32_t len, stm32_uart_tx_stop_cb_t stop)
+{
+    // Keep frame order with any async frame still waiting for the TX task
+    stm32_uart_tx_wait_done(portMAX_DELAY);
+
+    xSemaphoreTake(uart_tx_lock, portMAX_DELAY);
+    size_t total_sent = uart_tx_stream(data, len, stop);
+    if (total_sent < len) {
+        uart_wait_tx_done(CONFIG_ESP32_STM32_UART_CONTROLLER, portMAX_DELAY);
+    }
+    xSemaphoreGive(uart_tx_lock);
+
+    return total_sent;
+}
+
+/**
+ * @brief Change the KE link baud rate.
+ *
+ * Waits for pending TX to drain, switches the UART and then sends the auto
+ * baud sync character so the STM32 can lock onto the new rate.
+ *
+ * @param baud  New baud rate.
+ *
+ * @return ESP_OK on success, otherwise the UART driver error.
+ */
+esp_err_t stm32_uart_set_baud(uint32_t baud)
+{
+    stm32_uart_tx_wait_done(portMAX_DELAY);
+    xSemaphoreTake(uart_tx_lock, portMAX_DELAY);
+
+    uart_wait_tx_done(CONFIG_ESP32_STM32_UART_CONTROLLER, portMAX_DELAY);
+    esp_err_t err = uart_set_baudrate(CONFIG_ESP32_STM32_UART_CONTROLLER, baud);
+    if (err == ESP_OK) {
+        uart_baud = baud;
+        uart_flush_input(CONFIG_ESP32_STM32_UART_CONTROLLER);
+        atomic_store(&uart_line_errors, 0);
+
+        const char sync = STM32_UART_SYNC_CHAR;
+        uart_write_bytes(CONFIG_ESP32_STM32_UART_CONTROLLER, &sync, 1);
+        uart_wait_tx_done(CONFIG_ESP32_STM32_UART_CONTROLLER, portMAX_DELAY);
+        ESP_LOGI(TAG, "KE link baud rate set to %lu", (unsigned long)baud);
+    } else {
+        ESP_LOGE(TAG, "Failed to set baud rate %lu (%s)", (unsigned long)baud, esp_err_to_name(err));
+    }
+
+    xSemaphoreGive(uart_tx_lock);
+    return err;
+}
+
+uint32_t stm32_uart_get_baud(void)
+{
+    return uart_baud;
+}
+
+/**
+ * @brief Return the number of framing/parity errors since the last call.
+ */
+uint32_t stm32_uart_take_error_count(void)
+{
+    return atomic_exchange(&uart_line_errors, 0);
+}
+
+/* Stop the RX tasks and remove the driver so the UART can be reconfigured */
+static void uart_deinit(void)
+{
+    ESP_LOGI(TAG, "UART already initialized. Deinitializing first.");
+    // Never pull the driver out from under a frame that is still streaming
+    stm32_uart_tx_wait_done(portMAX_DELAY);
+    if (uart_tx_task_handle) {
+        vTaskDelete(uart_tx_task_handle);
+        uart_tx_task_handle = NULL;
+    }
+
+    // Delete tasks if already running
+    if (uart_task_handle) {
+        vTaskDelete(uart_task_handle);
+        uart_task_handle = NULL;
+    }
+
+    if (uart_parse_task_handle) {
+        vTaskDelete(uart_parse_task_handle);
+        uart_parse_task_handle = NULL;
+    }
+
+    // Delete UART driver
+    uart_driver_delete(CONFIG_ESP32_STM32_UART_CONTROLLER);
+    uart_event_queue = NULL;
+    uart_initialized = false;
+}
+
+void uart_init(PKE_PACKET_MANAGER dev_ptr)
+{
+    if (uart_initialized) {
+        uart_deinit();
     }
 
     const uart_config_t uart_config = {
-        .baud_rate = 921600,
+        .baud_rate = STM32_UART_BASE_BAUD,
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_EVEN,
         .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .flow_ctrl = STM32_UART_FLOW_CTRL,
+        .rx_flow_ctrl_thresh = STM32_UART_RTS_THRESH,
         .source_clk = UART_SCLK_APB,
     };
 
     const int uart_buffer_size = CONFIG_ESP32_STM32_UART_BUFFER_SIZE;
 
+    // No TX ring: frames are written from their own buffer by the TX task
     ESP_ERROR_CHECK(uart_driver_install(CONFIG_ESP32_STM32_UART_CONTROLLER,
                                         uart_buffer_size * 2,
-                                        uart_buffer_size * 2,
+                                        0,
                                         40,
                                         &uart_event_queue,
                                         0));
@@ -97,23 +574,58 @@ void uart_init(PKE_PACKET_MANAGER dev_ptr)
     ESP_ERROR_CHECK(uart_set_pin(CONFIG_ESP32_STM32_UART_CONTROLLER,
                                  CONFIG_STM32_RX_ESP32_TX,
                                  CONFIG_STM32_TX_ESP32_RX,
-                                 UART_PIN_NO_CHANGE,
-                                 UART_PIN_NO_CHANGE));
+                                 STM32_UART_RTS_PIN,
+                                 STM32_UART_CTS_PIN));
 
     ESP_ERROR_CHECK(uart_flush_input(CONFIG_ESP32_STM32_UART_CONTROLLER));
 
-    // Start the RX event task (FIXED)
-    BaseType_t task_ok = xTaskCreate(uart_event_task,
-                                    "uart_event_task",       // name
+    if (!uart_tx_lock) {
+        uart_tx_lock = xSemaphoreCreateMutex();
+        uart_tx_queue = xQueueCreate(1, sizeof(uart_tx_job_t));
+        uart_tx_events = xEventGroupCreate();
+    }
+    xQueueReset(uart_tx_queue);
+    xEventGroupSetBits(uart_tx_events, STM32_TX_IDLE_BIT);
+    uart_baud = STM32_UART_BASE_BAUD;
+    atomic_store(&uart_line_errors, 0);
+
+    ring_buffer_init(&rx_ring, rx_ring_storage, sizeof(rx_ring_storage));
+    stm32_flow_init();
+
+    // Start the parser task first so the RX task always has someone to wake
+    BaseType_t task_ok = xTaskCreate(uart_parse_task,
+                                    "uart_parse_task",       // name
                                     4096,                    // stack size
                                     dev_ptr,                 // param
-                                    12,                      // priority
-                                    &uart_task_handle);      // out handle
+                                    11,                      // priority
+                                    &uart_parse_task_handle); // out handle
+    if (task_ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create UART parse task");
+        return;
+    }
+
+    // Start the RX event task (FIXED)
+    task_ok = xTaskCreate(uart_event_task,
+                          "uart_event_task",       // name
+                          4096,                    // stack size
+                          NULL,                    // param
+                          12,                      // priority
+                          &uart_task_handle);      // out handle
     if (task_ok != pdPASS) {
         ESP_LOGE(TAG, "Failed to create UART RX task");
         return;
     }
 
+    task_ok = xTaskCreate(uart_tx_task,
+                          "uart_tx_task",          // name
+                          4096,                    // stack size
+                          NULL,                    // param
+                          10,                      // priority
+                          &uart_tx_task_handle);   // out handle
+    if (task_ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create UART TX task");
+        return;
+    }
 
     uart_initialized = true;
     ESP_LOGI(TAG, "UART DMA Initialized for RX/TX on UART%d", CONFIG_ESP32_STM32_UART_CONTROLLER);
@@ -123,17 +635,7 @@ void uart_init_for_stm32_bootloader(void)
 {
     // Deinit if already initialized
     if (uart_initialized) {
-        ESP_LOGI(TAG, "UART already initialized. Deinitializing first.");
-        // Delete task if already running
-        if (uart_task_handle) {
-            vTaskDelete(uart_task_handle);
-            uart_task_handle = NULL;
-        }
-
-        // Delete UART driver
-        uart_driver_delete(CONFIG_ESP32_STM32_UART_CONTROLLER);
-        uart_event_queue = NULL;
-        uart_initialized = false;
+        uart_deinit();
     }
 
     // Set up UART config
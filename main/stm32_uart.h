@@ -34,10 +34,30 @@ extern "C"
 #endif
 
 #include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "lib_ke_protocol.h"
 
+#define STM32_UART_BASE_BAUD 921600 // KE link rate after reset, before any negotiation
+#define STM32_UART_RX_NOTIFY_BIT (1UL << 0) // Set in the RX notify task's notification value
+
+typedef void (*stm32_uart_tx_done_cb_t)(int sent, void *arg);
+typedef bool (*stm32_uart_tx_stop_cb_t)(void);
+
 void uart_init(PKE_PACKET_MANAGER dev_ptr);
 void uart_init_for_stm32_bootloader(void);
+void stm32_uart_set_rx_notify(TaskHandle_t task);
+void stm32_uart_ingest(PKE_PACKET_MANAGER dev, const uint8_t *data, size_t len);
+int stm32_uart_write(const uint8_t *data, uint32_t len);
+int stm32_uart_write_preemptible(const uint8_t *data, uint32_t len, stm32_uart_tx_stop_cb_t stop);
+esp_err_t stm32_uart_write_async(const uint8_t *data, uint32_t len, stm32_uart_tx_done_cb_t done_cb, void *arg);
+bool stm32_uart_tx_wait_done(uint32_t timeout_ms);
+esp_err_t stm32_uart_set_baud(uint32_t baud);
+uint32_t stm32_uart_get_baud(void);
+uint32_t stm32_uart_take_error_count(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,149 @@
+#include "view_options.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "Options";
+
+/*
+ * The parts of the STM32 option list the ESP32 acts on, parsed once when a
+ * new list arrives instead of on every KE callback. Readers copy entries out
+ * under the lock, a rebuild swaps the whole table in one go.
+ */
+typedef struct {
+    int count;
+    bool *valid;                    // Entry was a usable string
+    view_background_t *backgrounds;
+} view_options_t;
+
+static view_options_t options;
+static SemaphoreHandle_t options_lock = NULL;
+
+static void view_options_free(view_options_t *model)
+{
+    free(model->valid);
+    free(model->backgrounds);
+    model->valid = NULL;
+    model->backgrounds = NULL;
+    model->count = 0;
+}
+
+/* Build the table for @p json_str, false leaves @p model empty */
+static bool view_options_parse(const char *json_str, view_options_t *model)
+{
+    cJSON *root = cJSON_Parse(json_str);
+    if (root == NULL) {
+        ESP_LOGW(TAG, "Error parsing option list");
+        return false;
+    }
+
+    cJSON *view_background = cJSON_GetObjectItemCaseSensitive(root, "view_background");
+    if (!cJSON_IsArray(view_background)) {
+        ESP_LOGW(TAG, "\"view_background\" is not an array or does not exist!");
+        cJSON_Delete(root);
+        return false;
+    }
+
+    int count = cJSON_GetArraySize(view_background);
+    model->valid = calloc(count ? count : 1, sizeof(bool));
+    model->backgrounds = calloc(count ? count : 1, sizeof(view_background_t));
+    if (!model->valid || !model->backgrounds) {
+        ESP_LOGE(TAG, "No memory for %d views", count);
+        view_options_free(model);
+        cJSON_Delete(root);
+        return false;
+    }
+    model->count = count;
+
+    // One walk of the list, cJSON_GetArrayItem() would restart from the head each time
+    int i = 0;
+    cJSON *user;
+    cJSON_ArrayForEach(user, view_background) {
+        view_background_t *bg = &model->backgrounds[i];
+        if (cJSON_IsString(user) && user->valuestring != NULL &&
+            strlen(user->valuestring) < sizeof(bg->name)) {
+            snprintf(bg->name, sizeof(bg->name), "%s", user->valuestring);
+            snprintf(bg->path, sizeof(bg->path), "/spiffs/%s.png", bg->name);
+            model->valid[i] = true;
+        }
+        i++;
+    }
+
+    cJSON_Delete(root);
+    return true;
+}
+
+void view_options_init(void)
+{
+    if (!options_lock) {
+        options_lock = xSemaphoreCreateMutex();
+    }
+}
+
+/**
+ * @brief Rebuild the option model from a newly received option list.
+ *
+ * Parsed outside the lock, readers only wait for the swap. A list that does
+ * not parse leaves no views.
+ */
+void view_options_update(const char *json_str)
+{
+    if (!options_lock) {
+        return;
+    }
+
+    view_options_t model = {0};
+    view_options_parse(json_str, &model);
+
+    xSemaphoreTake(options_lock, portMAX_DELAY);
+    view_options_t old = options;
+    options = model;
+    xSemaphoreGive(options_lock);
+
+    view_options_free(&old);
+    ESP_LOGI(TAG, "%d views in option list", model.count);
+}
+
+/**
+ * @brief Number of entries in the option list's view_background array.
+ */
+int view_options_background_count(void)
+{
+    if (!options_lock) {
+        return 0;
+    }
+
+    xSemaphoreTake(options_lock, portMAX_DELAY);
+    int count = options.count;
+    xSemaphoreGive(options_lock);
+
+    return count;
+}
+
+/**
+ * @brief Look up the background of a view.
+ *
+ * @param view          Index into view_background.
+ * @param background    Set to a copy of the entry.
+ *
+ * @return false if @p view is out of range or its entry is not a usable name.
+ */
+bool view_options_background(int view, view_background_t *background)
+{
+    if (!options_lock) {
+        return false;
+    }
+
+    xSemaphoreTake(options_lock, portMAX_DELAY);
+    bool found = view >= 0 && view < options.count && options.valid[view];
+    if (found) {
+        *background = options.backgrounds[view];
+    }
+    xSemaphoreGive(options_lock);
+
+    return found;
+}
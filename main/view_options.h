@@ -0,0 +1,23 @@
+#ifndef VIEW_OPTIONS_H
+#define VIEW_OPTIONS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VIEW_OPTIONS_NAME_SIZE 52
+#define VIEW_OPTIONS_PATH_SIZE 64
+
+/**
+ * @brief Background of one view, as listed in the option list.
+ */
+typedef struct {
+    char name[VIEW_OPTIONS_NAME_SIZE];  // As the webapp stores it, without extension
+    char path[VIEW_OPTIONS_PATH_SIZE];  // "/spiffs/<name>.png"
+} view_background_t;
+
+void view_options_init(void);
+void view_options_update(const char *json_str);
+int view_options_background_count(void);
+bool view_options_background(int view, view_background_t *background);
+
+#endif